@@ -1,8 +1,11 @@
 #pragma once
 
 #include "ir/graph.h"
+#include "simulator/chip_config.h"
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace dlcompiler {
 namespace codegen {
@@ -11,7 +14,56 @@ enum class InstructionType {
     LOAD, //load data from mem
     STORE, //store data to mem
     COMPUTE, //perform computation
-    SYNC //synchronization barrier
+    SYNC, //synchronization barrier
+    PREFETCH, //async weight load overlapped with the previous compute
+    DMA //activation move between memory levels
+};
+
+// where a tensor lives
+enum class MemoryLevel {
+    SCRATCHPAD, // per compute unit, software managed
+    L2, // shared, hardware managed
+    DRAM
+};
+
+std::string memoryLevelToString(MemoryLevel level);
+
+// convolution lowerings
+enum class ConvAlgorithm {
+    DIRECT, // loops over the filter window
+    IM2COL_GEMM, // unfold input patches into a matrix, one GEMM
+    WINOGRAD, // F(4x4, 3x3), 3x3 stride-1 only
+    FFT // pointwise products in the frequency domain, stride-1 only
+};
+
+std::string convAlgorithmToString(ConvAlgorithm algorithm);
+
+// how a pruned weight is stored and multiplied on the target
+struct SparseLowering {
+    std::string format = "dense"; // n:m, bsr RxC, csr or bitmap
+    bool skips_zeros = false; // kernel skips pruned weights, else they're expanded on chip
+    int64_t value_bytes = 0; // weights kept
+    int64_t index_bytes = 0; // metadata locating them
+    double flop_scale = 1.0; // share of the dense flops executed
+    double efficiency = 1.0; // throughput relative to the dense kernel
+    int64_t decode_flops = 0; // expanding compressed weights to dense on chip
+    int64_t flops_skipped = 0; // dense flops not executed
+    int64_t cycles = 0; // estimated on the target
+    
+    std::string toString() const;
+};
+
+// one way to lower a conv and what it costs on the target
+struct ConvCost {
+    ConvAlgorithm algorithm = ConvAlgorithm::DIRECT;
+    int64_t flops = 0;
+    int64_t workspace_bytes = 0; // unfolded patches / transformed tiles
+    int64_t transform_bytes = 0; // workspace traffic to mem, 0 while it fits the cache
+    int64_t weight_bytes = 0; // filter bank as stored for this algorithm
+    SparseLowering sparse; // pruned filters, dense for winograd / fft
+    double efficiency = 1.0; // fraction of peak SIMD throughput sustained
+    int64_t cycles = 0; // estimated on the target
+    int64_t cycles_saved = 0; // against direct
 };
 
 struct Instruction {
@@ -21,19 +73,125 @@ struct Instruction {
     int64_t output_size;
     int64_t flops;
     
+    // weight traffic
+    int value_id = -1; // tensor being moved, -1 for none
+    bool is_weight = false;
+    int64_t reuse = 1; // batch elements x output tiles sharing the weight
+    
+    int node_id = -1; // IR node this instruction was emitted for
+    
+    // DMA: input_size bytes into the scratchpad or output_size bytes out of
+    // it, as runs of run_bytes every run_stride bytes of the tensor
+    MemoryLevel src = MemoryLevel::DRAM;
+    MemoryLevel dst = MemoryLevel::DRAM;
+    int64_t offset = 0; // first byte within the tensor (value_id)
+    int64_t run_bytes = 0; // 0 = one contiguous run
+    int64_t run_stride = 0;
+    bool async = false; // double-buffered, overlaps the next compute
+    bool last_use = false; // tensor is dead after this read
+    
+    int64_t scratch_bytes = 0; // on-chip temporaries held during COMPUTE
+    int64_t working_set_bytes = 0; // whole op's operands + temporaries, on its first COMPUTE
+    
+    // conv lowering picked for this COMPUTE
+    std::string algorithm = "";
+    double efficiency = 1.0; // fraction of peak throughput sustained
+    int64_t cycles_saved = 0; // estimated against direct conv
+    
+    // pruned weights
+    std::string sparse_format = ""; // set on COMPUTEs of sparse ops
+    int64_t flops_skipped = 0; // dense flops the sparse kernel doesn't execute
+    int64_t index_bytes = 0; // on weight loads, sparse metadata included in input_size
+    
+    // activation lifetimes, set by generate() on a node's COMPUTEs
+    int64_t alloc_bytes = 0; // outputs that become live
+    int64_t free_bytes = 0; // inputs read here for the last time
+    
     std::string toString() const;
 };
 
+// activation lifetimes from graph structure alone, so each node's
+// instructions can be annotated on their own
+struct Liveness {
+    std::unordered_map<const ir::Value*, const ir::Node*> last_reader; // storage -> last compute reading it
+    std::unordered_set<const ir::Value*> pinned; // graph outputs, never freed
+    std::unordered_map<int, int> reader_of; // storage id -> last reader id
+    std::unordered_set<int> output_ids;
+};
+
 // generate instruction sequences from IR
 class CodeGenerator {
 public:
+    // conv algorithms and weight layouts are chosen for the target chip
+    explicit CodeGenerator(const simulator::ChipConfig& target = simulator::ChipConfig()) 
+        : target_(target) {}
+    
     std::vector<Instruction> generate(ir::Graph* graph);
     
-private:
-    void generateForNode(ir::Node* node, std::vector<Instruction>& instructions);
+    // instructions for one node; only depends on the node and its compute
+    // neighbours in program order (weight prefetch crosses that boundary),
+    // so segments can be regenerated independently
+    void generateForNode(ir::Node* node, ir::Node* prev_compute, ir::Node* next_compute,
+                         std::vector<Instruction>& instructions);
+    
+    static bool isComputeNode(const ir::Node* node);
+    
+    static Liveness analyzeLiveness(const std::vector<ir::Node*>& nodes);
+    // alloc/free bytes, last-use flags and DRAM endpoints for graph outputs
+    // on one node's instructions, instructions[first..]
+    void annotateLiveness(const ir::Node* node, const Liveness& liveness,
+                          std::vector<Instruction>& instructions, size_t first = 0) const;
+    
     int64_t computeFLOPs(ir::Node* node);
+    
+    // applicable lowerings of a conv node, cheapest first on the target
+    std::vector<ConvCost> convCandidates(const ir::Node* node) const;
+    ConvCost selectConvAlgorithm(const ir::Node* node) const;
+    
+    // storage formats and kernels for a MatMul / Conv2D weight, cheapest
+    // first; dense_flops and dense_efficiency describe the dense kernel
+    std::vector<SparseLowering> sparseCandidates(const ir::Node* node, int64_t dense_flops,
+                                                 double dense_efficiency) const;
+    // dense for ops without a pruned constant weight
+    SparseLowering selectSparseLowering(const ir::Node* node) const;
+    
+    // lower every conv that allows it with one algorithm, for comparisons
+    void forceConvAlgorithm(ConvAlgorithm algorithm) {
+        force_conv_ = true;
+        forced_conv_ = algorithm;
+        conv_choices_.clear();
+    }
+    
+    // conv choices are kept per node until generate() or until the node's
+    // attrs or input shapes change, which callers of generateForNode report here
+    void invalidate(int node_id) { conv_choices_.erase(node_id); }
+    void invalidateAll() { conv_choices_.clear(); }
+    
+private:
+    // tiles a node so each tile's operands fit half the scratchpads, with
+    // DMA moves for tile t + 1 issued ahead of tile t's compute
+    void generateTiles(ir::Node* node, int64_t weight_size, 
+                       const std::vector<Instruction>& prefetches,
+                       std::vector<Instruction>& instructions);
+    void generateAttention(ir::Node* node, const std::vector<Instruction>& prefetches,
+                           std::vector<Instruction>& instructions);
+    // selectConvAlgorithm, once per node
+    const ConvCost& convChoice(const ir::Node* node) const;
+    int64_t gradientFLOPs(ir::Node* node);
+    int64_t weightReuse(ir::Node* node);
+    int64_t weightBytes(const ir::Node* node, const ir::Value* weight) const;
+    int64_t indexBytes(const ir::Node* node, const ir::Value* weight) const;
+    int64_t estimateCycles(double flops, double efficiency, int64_t bytes) const;
+    MemoryLevel homeLevel(const ir::Value* value) const;
+    Instruction dma(ir::Node* node, const ir::Value* value, bool inbound, int64_t bytes,
+                    int64_t offset) const;
+    static void placeInStorage(Instruction& move, const ir::Value* value);
+    
+    simulator::ChipConfig target_;
+    bool force_conv_ = false;
+    ConvAlgorithm forced_conv_ = ConvAlgorithm::DIRECT;
+    mutable std::unordered_map<int, ConvCost> conv_choices_; // node id -> lowering
 };
 
 }
 }
-
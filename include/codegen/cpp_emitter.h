@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ir/graph.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dlcompiler {
+namespace codegen {
+
+// static activation buffer plan: values whose lifetimes don't overlap
+// share arena space
+struct BufferPlan {
+    std::unordered_map<int, int64_t> offsets; // value id -> arena offset in floats
+    int64_t arena_floats = 0;
+};
+
+// emits a standalone C++ translation unit for a graph: one kernel call per
+// node with shapes, strides and tiles as template arguments, AVX2 inner
+// loops with a scalar fallback, fused epilogues inlined, and a single
+// run(inputs, outputs) entry point
+class CppEmitter {
+public:
+    std::string emit(ir::Graph* graph);
+
+    const BufferPlan& plan() const { return plan_; }
+
+private:
+    void planBuffers(const std::vector<ir::Node*>& nodes);
+    std::string valueRef(const ir::Value* value) const;
+    std::string emitKernelCall(const ir::Node* node) const;
+
+    BufferPlan plan_;
+    std::unordered_map<int, int> input_index_; // graph input value id -> run() slot
+};
+
+}
+}
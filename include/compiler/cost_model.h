@@ -0,0 +1,21 @@
+#pragma once
+
+#include "optimizer/optimizer.h"
+#include "simulator/chip_config.h"
+
+namespace dlcompiler {
+namespace compiler {
+
+// cost of a graph as its generated program simulates on one chip
+class SimulatedCost : public optimizer::CostModel {
+public:
+    explicit SimulatedCost(const simulator::ChipConfig& config) : config_(config) {}
+    
+    int64_t cycles(ir::Graph* graph) const override;
+    
+private:
+    simulator::ChipConfig config_;
+};
+
+}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ir/graph.h"
+#include "optimizer/optimizer.h"
+#include "codegen/codegen.h"
+#include "simulator/simulator.h"
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dlcompiler {
+namespace compiler {
+
+// keeps per-node instruction segments, simulator stats and simulator state
+// so an edit only recompiles the nodes it reaches
+class IncrementalCompiler {
+public:
+    // work done by the last update()
+    struct UpdateStats {
+        size_t reoptimized = 0;
+        size_t reemitted = 0;
+        size_t resimulated = 0;
+    };
+    
+    IncrementalCompiler(ir::Graph* graph, optimizer::Optimizer& opt,
+                        const simulator::ChipConfig& config);
+    
+    // full optimize + codegen + simulate
+    const simulator::ExecutionStats& compile();
+    
+    // edit a node attribute, applied on the next update()
+    void setAttr(ir::Node* node, const std::string& key, int64_t value);
+    
+    // recompile only the edited nodes and whatever their shapes reach;
+    // nodes the optimizer erases or adds there are spliced into program
+    // order, and only optimizers that can't rerun on a region alone fall
+    // back to compile()
+    const simulator::ExecutionStats& update();
+    
+    std::vector<codegen::Instruction> instructions() const;
+    const simulator::ExecutionStats& stats() const { return total_; }
+    const UpdateStats& lastUpdate() const { return last_update_; }
+    
+private:
+    void rebuildIndex();
+    // patch program order for the optimizer's erased and added nodes and
+    // collect the ids whose segments go stale; false if an added node has
+    // no place in the current order
+    bool splice(std::unordered_set<int>& redo);
+    void refreshLiveness(std::unordered_set<int>& redo);
+    void emit(size_t pos);
+    void simulateFrom(size_t start, size_t last_emitted);
+    void finalizeTotal();
+    ir::Node* prevCompute(size_t pos) const;
+    ir::Node* nextCompute(size_t pos) const;
+    
+    ir::Graph* graph_;
+    optimizer::Optimizer& opt_;
+    codegen::CodeGenerator codegen_;
+    simulator::Simulator sim_;
+    
+    std::vector<ir::Node*> order_; // program order
+    std::unordered_map<int, size_t> position_; // node id -> index in order_
+    optimizer::RegionState region_; // readers of every value, kept current by the passes
+    codegen::Liveness liveness_; // structural, refreshed after graph edits
+    
+    // all indexed by position in order_
+    std::vector<std::vector<codegen::Instruction>> segments_;
+    std::vector<simulator::ExecutionStats> node_stats_;
+    std::vector<simulator::Simulator::State> state_after_;
+    
+    simulator::ExecutionStats raw_; // sum of node_stats_
+    std::multiset<int64_t> sram_peaks_; // per-node peaks, since -= can't undo a max
+    std::multiset<int64_t> activation_peaks_;
+    std::multiset<int64_t> working_set_peaks_;
+    simulator::ExecutionStats total_;
+    std::unordered_set<int> dirty_;
+    UpdateStats last_update_;
+};
+
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ir/graph.h"
+#include "optimizer/optimizer.h"
+#include "codegen/codegen.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dlcompiler {
+namespace compiler {
+
+// program compiled for one set of symbol values
+struct CompiledVariant {
+    ir::Bindings bindings; // sizes the program was compiled for
+    std::vector<codegen::Instruction> instructions;
+};
+
+// compiles a symbolic graph once per shape bucket and picks a variant at
+// runtime; shapes are padded up to the next bucket, larger ones are
+// compiled exactly on first use and kept in a bounded LRU
+class SpecializationCache {
+public:
+    // graph is optimized once here, passes don't depend on concrete shapes
+    SpecializationCache(std::unique_ptr<ir::Graph> graph, optimizer::Optimizer& opt,
+                        size_t max_exact = 16);
+    
+    void setBuckets(const std::string& symbol, std::vector<int64_t> sizes);
+    
+    // compile every bucket combination
+    void compile();
+    
+    // an exact-shape result stays valid until it is evicted by later lookups
+    const CompiledVariant& lookup(const ir::Bindings& bindings);
+    
+    const ir::Graph& generic() const { return *generic_; }
+    size_t numVariants() const { return variants_.size() + exact_.size(); }
+    int64_t bucketHits() const { return bucket_hits_; }
+    int64_t fallbacks() const { return fallbacks_; }
+    int64_t evictions() const { return evictions_; }
+    
+private:
+    CompiledVariant compileVariant(const ir::Bindings& bindings);
+    
+    std::unique_ptr<ir::Graph> generic_;
+    std::vector<std::string> symbols_;
+    std::vector<std::vector<int64_t>> buckets_; // sorted, parallel to symbols_
+    std::vector<CompiledVariant> variants_; // mixed-radix index over buckets_
+    
+    // shapes past the last bucket, most recently used first
+    using ExactEntry = std::pair<std::vector<int64_t>, CompiledVariant>;
+    std::list<ExactEntry> exact_;
+    std::map<std::vector<int64_t>, std::list<ExactEntry>::iterator> exact_index_;
+    size_t max_exact_;
+    
+    codegen::CodeGenerator codegen_;
+    int64_t bucket_hits_ = 0;
+    int64_t fallbacks_ = 0;
+    int64_t evictions_ = 0;
+};
+
+}
+}
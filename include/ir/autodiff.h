@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ir/graph.h"
+#include <unordered_map>
+#include <vector>
+
+namespace dlcompiler {
+namespace ir {
+
+// result of appending a backward pass to a forward graph
+struct BackwardGraph {
+    std::vector<Value*> output_grads; // one seed INPUT per forward output
+    std::unordered_map<int, Value*> param_grads; // parameter value id -> its gradient
+};
+
+// reverse-mode autodiff: every parameter (Value::isParameter) gets a
+// gradient OUTPUT, other constants are held fixed; backward nodes carry attr "backward" so later passes can
+// tell the two halves of the training step apart
+BackwardGraph buildBackward(Graph* graph);
+
+// true for nodes created by buildBackward (or recomputing forward values for it)
+inline bool isBackwardNode(const Node* node) {
+    return node->getAttr("backward") != 0;
+}
+
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace dlcompiler {
+namespace ir {
+
+// symbol name -> concrete size
+using Bindings = std::unordered_map<std::string, int64_t>;
+
+// dimension size: constant, named symbol, or arithmetic over those
+class DimExpr {
+public:
+    DimExpr() : DimExpr(0) {}
+    DimExpr(int64_t value); // implicit so plain sizes mix with symbols
+
+    static DimExpr symbol(const std::string& name);
+
+    bool isConstant() const;
+    int64_t constant() const; // only valid when isConstant()
+
+    // throws if a symbol is missing from bindings
+    int64_t evaluate(const Bindings& bindings) const;
+    void collectSymbols(std::set<std::string>& symbols) const;
+
+    DimExpr floorDiv(const DimExpr& rhs) const;
+
+    friend DimExpr operator+(const DimExpr& lhs, const DimExpr& rhs);
+    friend DimExpr operator-(const DimExpr& lhs, const DimExpr& rhs);
+    friend DimExpr operator*(const DimExpr& lhs, const DimExpr& rhs);
+
+    // same expression tree; no algebra, so a + b and b + a differ
+    bool operator==(const DimExpr& other) const { return equal(node_.get(), other.node_.get()); }
+    bool operator!=(const DimExpr& other) const { return !(*this == other); }
+
+    std::string toString() const;
+
+private:
+    enum class Kind { CONST, SYMBOL, ADD, SUB, MUL, DIV };
+    struct Node;
+
+    explicit DimExpr(std::shared_ptr<const Node> node) : node_(std::move(node)) {}
+    static DimExpr binary(Kind kind, const DimExpr& lhs, const DimExpr& rhs);
+    static bool equal(const Node* lhs, const Node* rhs);
+
+    std::shared_ptr<const Node> node_;
+};
+
+}
+}
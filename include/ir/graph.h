@@ -1,26 +1,46 @@
 #pragma once
 
+#include "ir/dim_expr.h"
 #include <memory>
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace dlcompiler {
 namespace ir {
 
 // tensor shape rep
+// symbolic dims hold kDynamic in dims and their expression in exprs
 struct Shape {
+    static constexpr int64_t kDynamic = -1;
+    
     std::vector<int64_t> dims;
+    std::vector<DimExpr> exprs; // empty when every dim is static
     
     Shape() = default;
     Shape(std::initializer_list<int64_t> d) : dims(d) {}
+    Shape(std::initializer_list<DimExpr> d) : Shape(std::vector<DimExpr>(d)) {}
+    Shape(const std::vector<DimExpr>& d);
+    
+    size_t rank() const { return dims.size(); }
+    bool isStatic() const { return exprs.empty(); }
+    DimExpr dim(size_t i) const { return isStatic() ? DimExpr(dims[i]) : exprs[i]; }
     
     int64_t numel() const {
+        if (!isStatic()) return kDynamic;
         int64_t n = 1;
         for (auto d : dims) n *= d;
         return n;
     }
     
+    // concrete shape for the given symbol values
+    Shape bind(const Bindings& bindings) const;
+    void collectSymbols(std::set<std::string>& symbols) const;
+    
+    bool operator==(const Shape& other) const;
+    bool operator!=(const Shape& other) const { return !(*this == other); }
+    
     std::string toString() const;
 };
 
@@ -28,18 +48,57 @@ struct Shape {
 enum class OpType {
     INPUT,
     OUTPUT,
+    CONSTANT, // weights / parameters known at compile time
     CONV2D,
     MATMUL,
     RELU,
     ADD,
     MAXPOOL,
     BATCHNORM,
+    SOFTMAX, // over the last axis
+    LAYERNORM, // over the last axis, gamma/beta constants
+    GELU,
+    RESHAPE,
+    TRANSPOSE,
+    SPLIT, // consecutive slices of one axis, one output each
     FUSED_CONV_RELU, // optimized fused operation
-    FUSED_MATMUL_ADD // optimized fused operation
+    FUSED_MATMUL_ADD, // optimized fused operation
+    FUSED_ATTENTION, // softmax(Q K^T) V without materializing the scores
+    GRADIENT // backward of attr fwd_op w.r.t. its inputs wrt_0..wrt_{num_grads-1}
 };
 
 std::string opTypeToString(OpType type);
 
+// empty if q: [..., S, D], k: [..., S_kv, D], v: [..., S_kv, D_v] share
+// their leading (batch x heads) dims, otherwise what doesn't line up
+std::string attentionShapeMismatch(const Shape& q, const Shape& k, const Shape& v);
+
+// pruning pattern of an op's weight; rows are output channels and the
+// pattern runs along the reduction axis
+enum class SparsityPattern {
+    DENSE,
+    UNSTRUCTURED, // zeros anywhere
+    N_OF_M, // at most n nonzeros in every m consecutive weights, e.g. 2:4
+    BLOCK // whole block_rows x block_cols tiles pruned
+};
+
+struct Sparsity {
+    SparsityPattern pattern = SparsityPattern::DENSE;
+    int64_t n = 0;
+    int64_t m = 0;
+    int64_t block_rows = 1;
+    int64_t block_cols = 1;
+    double density = 1.0; // share of weights kept
+    
+    static Sparsity unstructured(double density);
+    static Sparsity nOfM(int64_t n, int64_t m);
+    static Sparsity block(int64_t rows, int64_t cols, double density);
+    
+    bool isDense() const { return pattern == SparsityPattern::DENSE; }
+    
+    std::string toString() const;
+};
+
 // forward declarations
 class Node;
 class Graph;
@@ -47,15 +106,41 @@ class Graph;
 // tensor value in graph
 class Value {
 public:
-    Value(int id, const Shape& shape) : id_(id), shape_(shape) {}
+    Value(int id, const Shape& shape, int64_t elem_bytes = sizeof(float))
+        : id_(id), shape_(shape), elem_bytes_(elem_bytes) {}
     
     int id() const { return id_; }
     const Shape& shape() const { return shape_; }
     void setShape(const Shape& shape) { shape_ = shape; }
     
+    // constants are weights/parameters, everything else is an activation
+    bool isConstant() const { return constant_; }
+    void setConstant(bool constant) { constant_ = constant; }
+    
+    // trainable constants, the ones autodiff produces gradients for; folded
+    // results and other fixed constants aren't
+    bool isParameter() const { return parameter_; }
+    void setParameter(bool parameter) { parameter_ = parameter; }
+    
+    // node computing this value
+    Node* producer() const { return producer_; }
+    void setProducer(Node* node) { producer_ = node; }
+    
+    int64_t elemBytes() const { return elem_bytes_; }
+    int64_t bytes() const { return shape_.numel() * elem_bytes_; }
+    
+    // buffer holding this value's bytes: reshape outputs rename their input
+    // and split pieces are slices of it; through_splits = false stops at
+    // pieces, for backends that copy them out
+    const Value* storage(bool through_splits = true) const;
+    
 private:
     int id_;
     Shape shape_;
+    int64_t elem_bytes_;
+    bool constant_ = false;
+    bool parameter_ = false;
+    Node* producer_ = nullptr;
 };
 
 // operation node in computation graph
@@ -71,7 +156,9 @@ public:
     const std::vector<Value*>& outputs() const { return outputs_; }
     
     void addInput(Value* v) { inputs_.push_back(v); }
-    void addOutput(Value* v) { outputs_.push_back(v); }
+    void addOutput(Value* v) { outputs_.push_back(v); v->setProducer(this); }
+    void setInput(size_t idx, Value* v) { inputs_[idx] = v; }
+    void clearInputs() { inputs_.clear(); }
     
     void setAttr(const std::string& key, int64_t value) { 
         int_attrs_[key] = value; 
@@ -85,6 +172,10 @@ public:
         return int_attrs_;
     }
     
+    // weight sparsity, kept in attrs so clones, fused ops and gradients carry it
+    void setSparsity(const Sparsity& sparsity);
+    Sparsity sparsity() const;
+    
     std::string toString() const;
     
 private:
@@ -105,12 +196,34 @@ public:
     // add operations
     Value* addInput(const Shape& shape);
     Value* addOutput(Value* input);
+    Value* addConstant(const Shape& shape, int64_t elem_bytes = sizeof(float));
+    // a constant that training updates; conv and layernorm weights are made this way
+    Value* addParameter(const Shape& shape, int64_t elem_bytes = sizeof(float));
     Value* addConv2D(Value* input, int64_t out_channels, int64_t kernel_size, 
                      int64_t stride, int64_t padding);
     Value* addMatMul(Value* a, Value* b);
     Value* addReLU(Value* input);
     Value* addAdd(Value* a, Value* b);
     Value* addMaxPool(Value* input, int64_t kernel_size, int64_t stride);
+    Value* addSoftmax(Value* input);
+    Value* addLayerNorm(Value* input);
+    Value* addGELU(Value* input);
+    // one dim may be -1 and is inferred from the element count
+    Value* addReshape(Value* input, const std::vector<int64_t>& dims);
+    Value* addTranspose(Value* input, const std::vector<int64_t>& perm);
+    // cuts axis into consecutive pieces of the given sizes
+    std::vector<Value*> addSplit(Value* input, int64_t axis, const std::vector<int64_t>& sizes);
+    // q: [..., S, D], k: [..., S_kv, D], v: [..., S_kv, D_v], one K/V per
+    // query head; throws std::invalid_argument otherwise
+    Value* addAttention(Value* q, Value* k, Value* v);
+    // backward of forward w.r.t. the inputs listed in wrt: reads the
+    // incoming gradient plus the forward tensors in saved, one output per wrt
+    std::vector<Value*> addGradient(const Node* forward, Value* grad_output,
+                                    const std::vector<Value*>& saved,
+                                    const std::vector<int>& wrt);
+    
+    // same op and attrs over new inputs, with fresh outputs
+    Node* cloneNode(const Node* node, const std::vector<Value*>& inputs);
     
     std::vector<Node*> getNodes() const;
     std::vector<Node*> getNodesInTopoOrder() const;
@@ -119,14 +232,31 @@ public:
     int numNodes() const { return nodes_.size(); }
     int numValues() const { return values_.size(); }
     
-    Node* getNode(int id) const { return nodes_[id].get(); }
-    Value* getValue(int id) const { return values_[id].get(); }
+    Node* getNode(int id) const;
+    Value* getValue(int id) const; // nullptr once removed
+    
+    // nodes reading value v
+    std::vector<Node*> getUsers(const Value* v) const;
+    void removeNode(Node* node);
+    void removeNodes(const std::unordered_set<Node*>& nodes); // one pass
+    void removeValues(const std::unordered_set<Value*>& values); // must be unreferenced
+    
+    // recompute node's output shape from its inputs and attrs,
+    // returns true if the shape changed
+    bool inferShape(Node* node);
+    
+    // symbols appearing in any value shape
+    std::set<std::string> symbols() const;
+    bool isStatic() const { return symbols().empty(); }
+    
+    // copy of this graph with every symbolic dim bound to a concrete size
+    std::unique_ptr<Graph> specialize(const Bindings& bindings) const;
     
     void print() const;
     
 private:
     Node* createNode(OpType type);
-    Value* createValue(const Shape& shape);
+    Value* createValue(const Shape& shape, int64_t elem_bytes = sizeof(float));
     
     std::vector<std::unique_ptr<Node>> nodes_;
     std::vector<std::unique_ptr<Value>> values_;
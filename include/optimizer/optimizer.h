@@ -1,7 +1,11 @@
 #pragma once
 
 #include "ir/graph.h"
+#include "optimizer/pattern.h"
 #include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace dlcompiler {
@@ -12,23 +16,82 @@ public:
     virtual ~Pass() = default;
     virtual bool run(ir::Graph* graph) = 0;
     virtual std::string name() const = 0;
+    
+    // rerun over a few edited nodes, keeping state.uses current and
+    // recording the nodes erased, added or rewired; passes that can't
+    // localize their work fall back to the whole graph and say so in
+    // localizes()
+    virtual bool runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                             RegionState& state) {
+        (void)region;
+        (void)state;
+        return run(graph);
+    }
+    virtual bool localizes() const { return false; }
 };
 
-// fuse consecutive ops
+// fuse consecutive ops, declared as rewrite rules
 class FusionPass : public Pass {
 public:
+    FusionPass();
+    
     bool run(ir::Graph* graph) override;
     std::string name() const override { return "FusionPass"; }
+    bool runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                     RegionState& state) override;
+    bool localizes() const override { return true; }
     
 private:
-    bool fuseConvReLU(ir::Graph* graph);
-    bool fuseMatMulAdd(ir::Graph* graph);
+    RewriteRuleSet rules_;
+};
+
+// prices a standalone graph for passes choosing between rewrites, so they
+// needn't know how the target runs it
+class CostModel {
+public:
+    virtual ~CostModel() = default;
+    virtual int64_t cycles(ir::Graph* graph) const = 0;
+};
+
+// merge sibling MatMuls / Conv2Ds reading the same input into one wide op
+// over concatenated weights, followed by a split, so the input is loaded once;
+// with a cost model a group is only merged when it prices cheaper, readers of
+// the pieces included since they now read strided bands of the wide output
+class HorizontalFusionPass : public Pass {
+public:
+    explicit HorizontalFusionPass(std::shared_ptr<const CostModel> cost = nullptr) 
+        : cost_(std::move(cost)) {}
+    
+    bool run(ir::Graph* graph) override;
+    std::string name() const override { return "HorizontalFusionPass"; }
+    
+private:
+    using Users = std::unordered_map<const ir::Value*, std::vector<ir::Node*>>;
+    
+    // priced cycles of the group and its readers, separate or merged
+    int64_t groupCycles(const ir::Value* shared, const std::vector<ir::Node*>& group, 
+                        const Users& users, bool merged) const;
+    
+    std::shared_ptr<const CostModel> cost_; // null merges every group
 };
 
 class MemoryLayoutPass : public Pass {
 public:
     bool run(ir::Graph* graph) override;
     std::string name() const override { return "MemoryLayoutPass"; }
+    bool runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                     RegionState& state) override;
+    bool localizes() const override { return true; }
+};
+
+// evaluate ops whose inputs are all constants at compile time
+class ConstantFoldingPass : public Pass {
+public:
+    bool run(ir::Graph* graph) override;
+    std::string name() const override { return "ConstantFoldingPass"; }
+    bool runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                     RegionState& state) override;
+    bool localizes() const override { return true; }
 };
 
 // remove unused ops
@@ -38,6 +101,40 @@ public:
     std::string name() const override { return "DeadCodeEliminationPass"; }
 };
 
+// activation checkpointing for training graphs: forward activations the
+// backward pass reads are recomputed instead of kept until the activation
+// peak fits the budget, picking the values that free the most bytes per
+// recomputed FLOP
+class RematerializationPass : public Pass {
+public:
+    explicit RematerializationPass(int64_t budget_bytes) : budget_bytes_(budget_bytes) {}
+    
+    bool run(ir::Graph* graph) override;
+    std::string name() const override { return "RematerializationPass"; }
+    
+    int64_t peakBytes() const { return peak_bytes_; }
+    int64_t extraFLOPs() const { return extra_flops_; }
+    int numRecomputed() const { return num_recomputed_; }
+    
+private:
+    // graph edits of one eviction, so a rejected one can be rolled back
+    struct Edit {
+        std::vector<std::tuple<ir::Node*, size_t, ir::Value*>> rewired;
+        std::unordered_set<ir::Node*> created;
+        std::vector<const ir::Value*> mapped;
+    };
+    
+    void evict(ir::Graph* graph, ir::Value* value, Edit& edit);
+    void rewire(ir::Graph* graph, ir::Value* from, ir::Value* to, Edit& edit);
+    void undo(ir::Graph* graph, const Edit& edit);
+    
+    int64_t budget_bytes_;
+    int64_t peak_bytes_ = 0;
+    int64_t extra_flops_ = 0;
+    int num_recomputed_ = 0;
+    std::unordered_map<const ir::Value*, ir::Value*> recomputed_; // forward value -> copy
+};
+
 // manage and run optimization passes
 class Optimizer {
 public:
@@ -47,6 +144,11 @@ public:
     
     void run(ir::Graph* graph);
     
+    // incremental rerun over nodes touched by an edit
+    bool runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region, RegionState& state);
+    // every pass can rerun on a region alone
+    bool localizes() const;
+    
 private:
     std::vector<std::unique_ptr<Pass>> passes_;
 };
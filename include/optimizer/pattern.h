@@ -0,0 +1,172 @@
+#pragma once
+
+#include "ir/graph.h"
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dlcompiler {
+namespace optimizer {
+
+// value -> nodes reading it, kept up to date while rewriting
+using UseMap = std::unordered_map<const ir::Value*, std::vector<ir::Node*>>;
+
+// use map a caller keeps across region reruns, plus what the last rerun did
+// to the graph so the caller can patch its own indices instead of rebuilding
+struct RegionState {
+    UseMap uses;
+    std::vector<int> erased; // ids of removed nodes
+    std::vector<ir::Node*> added;
+    std::unordered_set<int> touched; // ids of nodes whose op or inputs changed
+
+    void clearEdits() {
+        erased.clear();
+        added.clear();
+        touched.clear();
+    }
+};
+
+// node ids waiting for the driver, each queued at most once
+class Worklist {
+public:
+    void push(int id) {
+        if (queued_.insert(id).second) order_.push_back(id);
+    }
+    int pop() {
+        int id = order_.front();
+        order_.pop_front();
+        queued_.erase(id);
+        return id;
+    }
+    bool empty() const { return order_.empty(); }
+    size_t size() const { return order_.size(); }
+
+private:
+    std::deque<int> order_;
+    std::unordered_set<int> queued_;
+};
+
+// nodes and operand values captured by a successful match
+struct Match {
+    ir::Node* root = nullptr;
+    std::unordered_map<std::string, ir::Node*> nodes;
+    std::unordered_map<std::string, ir::Value*> values;
+
+    ir::Node* node(const std::string& name) const { return nodes.at(name); }
+    ir::Value* value(const std::string& name) const { return values.at(name); }
+};
+
+// DAG pattern: node op type, attribute predicates, use constraints and
+// operand sub-patterns, e.g.
+//   Pattern::op(RELU).operands({Pattern::op(CONV2D).singleUse().bind("conv")})
+class Pattern {
+public:
+    static Pattern op(ir::OpType type);
+    static Pattern any(); // operand wildcard, matches any value
+
+    Pattern& operands(std::vector<Pattern> operands);
+    Pattern& commutative(); // two operands may match in either order
+    Pattern& attrEq(const std::string& key, int64_t value);
+    Pattern& where(std::function<bool(const ir::Node*)> pred);
+    Pattern& singleUse(); // output read by exactly one node
+    Pattern& bind(const std::string& name);
+
+    bool isWildcard() const { return wildcard_; }
+    ir::OpType type() const { return type_; }
+
+    bool match(ir::Node* node, const UseMap& uses, Match& m) const;
+
+private:
+    bool matchOperand(ir::Value* value, const UseMap& uses, Match& m) const;
+    bool matchOperands(ir::Node* node, const UseMap& uses, Match& m, bool swapped) const;
+
+    bool wildcard_ = false;
+    ir::OpType type_ = ir::OpType::INPUT;
+    std::vector<Pattern> operands_;
+    bool commutative_ = false;
+    std::vector<std::function<bool(const ir::Node*)>> preds_;
+    bool single_use_ = false;
+    std::string name_;
+};
+
+// graph edits available to rewrite callbacks; keeps the use map and the
+// driver worklist consistent
+class Rewriter {
+public:
+    // builds its own use map over the whole graph
+    Rewriter(ir::Graph* graph, Worklist& worklist);
+    // edits a caller's use map in place and records erased, added and
+    // touched nodes in it
+    Rewriter(ir::Graph* graph, Worklist& worklist, RegionState& state);
+
+    ir::Graph* graph() const { return graph_; }
+    const UseMap& uses() const { return state_.uses; }
+
+    void setType(ir::Node* node, ir::OpType type);
+    void addInput(ir::Node* node, ir::Value* value);
+    void setInputs(ir::Node* node, const std::vector<ir::Value*>& values);
+    void replaceAllUsesWith(ir::Value* from, ir::Value* to);
+    void eraseNode(ir::Node* node); // node must have no remaining users
+    // copy of node over new inputs, e.g. to unshare a value
+    ir::Node* cloneNode(const ir::Node* node, const std::vector<ir::Value*>& inputs);
+    void notifyChanged(ir::Node* node);
+
+    bool isErased(ir::Node* node) const { return erased_.count(node) > 0; }
+
+    // drop erased nodes from the graph in one pass
+    void commit();
+
+private:
+    ir::Graph* graph_;
+    Worklist& worklist_;
+    RegionState owned_;
+    RegionState& state_;
+    std::unordered_set<ir::Node*> erased_;
+};
+
+struct RewriteRule {
+    std::string name;
+    Pattern pattern;
+    // returns false to decline the match
+    std::function<bool(Rewriter&, const Match&)> rewrite;
+    int benefit = 1; // higher benefit rules are tried first
+};
+
+// rules indexed by root op type; only rules whose root can match a node
+// are ever tried on it
+class RewriteRuleSet {
+public:
+    void add(RewriteRule rule);
+
+    const std::vector<const RewriteRule*>& candidates(ir::OpType type) const;
+    bool empty() const { return rules_.empty(); }
+
+private:
+    std::deque<RewriteRule> rules_; // stable addresses for the index
+    std::unordered_map<int, std::vector<const RewriteRule*>> by_root_;
+    std::vector<const RewriteRule*> wildcard_roots_;
+};
+
+// worklist driver: applies every rule until none matches anywhere
+class PatternRewriteDriver {
+public:
+    explicit PatternRewriteDriver(const RewriteRuleSet& rules) : rules_(rules) {}
+
+    // returns the number of rewrites applied
+    int run(ir::Graph* graph);
+    int run(ir::Graph* graph, const std::vector<ir::Node*>& seeds);
+    // seeds only, over a use map the caller keeps current
+    int run(ir::Graph* graph, const std::vector<ir::Node*>& seeds, RegionState& state);
+
+private:
+    int drain(ir::Graph* graph, const std::vector<ir::Node*>& seeds, Worklist& worklist,
+              Rewriter& rewriter);
+
+    const RewriteRuleSet& rules_;
+};
+
+}
+}
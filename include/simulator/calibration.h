@@ -0,0 +1,57 @@
+#pragma once
+
+#include "simulator/chip_config.h"
+#include <string>
+#include <vector>
+
+namespace dlcompiler {
+namespace simulator {
+
+// one host microbenchmark result
+struct Measurement {
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+// simulated against measured time for one kernel shape
+struct AccuracyEntry {
+    std::string kernel;
+    double measured_ms;
+    double predicted_ms;
+    bool fitted; // shape was used to fit the efficiency factors
+    
+    double error() const { return (predicted_ms - measured_ms) / measured_ms; }
+};
+
+struct CalibrationResult {
+    ChipConfig config;
+    std::vector<Measurement> measurements;
+    std::vector<AccuracyEntry> accuracy;
+    
+    // mean |error| over shapes not used for fitting
+    double heldOutError() const;
+    
+    void print() const;
+};
+
+// fits a single-core ChipConfig to the local host: microbenchmarks give the
+// clock, SIMD throughput, cache knees, bandwidths and latencies; measured
+// GEMM and direct conv kernels then give the per-kernel efficiency factors
+class Calibrator {
+public:
+    CalibrationResult run();
+
+private:
+    void measureClock();
+    void measureCompute();
+    void measureMemory();
+    void fitKernelEfficiency();
+    
+    void record(const std::string& name, double value, const std::string& unit);
+    
+    CalibrationResult result_;
+};
+
+}
+}
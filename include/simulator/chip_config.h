@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace dlcompiler {
+namespace simulator {
+
+// hardware config
+struct ChipConfig {
+    int compute_units = 16; // num of parallel compute units
+    double memory_bandwidth_gb_s = 100; // DRAM bandwidth over all channels
+    int scratchpad_kb = 64; // software-managed scratchpad per compute unit
+    int simd_width = 8; // SIMD vector width
+    double clock_freq_ghz = 1.5; // clock frequency
+    int weight_buffer_kb = 128; // on-chip buffer holding stationary weights
+    
+    // sparse acceleration: the n:m pattern the datapath skips zeros for
+    // natively (2:4 on sparse tensor cores), 0:0 when there is none
+    int sparse_n = 0;
+    int sparse_m = 0;
+    double sparse_gather_efficiency = 0.2; // index-driven sparse kernels vs dense throughput
+    
+    // shared L2 between the scratchpads and DRAM
+    int l2_size_kb = 2048;
+    double l2_bandwidth_gb_s = 400;
+    int l2_latency_cycles = 20;
+    
+    // banked DRAM: consecutive rows interleave across channels, then banks
+    int dram_channels = 4;
+    int dram_banks = 8; // per channel
+    int dram_row_bytes = 2048; // row buffer per bank
+    int dram_latency_cycles = 100; // first data of a blocking access
+    int dram_row_miss_cycles = 30; // precharge + activate on a row-buffer miss
+    
+    // sustained fraction of the cost model's throughput per kernel class,
+    // 1.0 until fitted against measured kernels
+    double matmul_efficiency = 1.0;
+    double conv_efficiency = 1.0;
+    
+    int64_t scratchpadBytes() const {
+        return static_cast<int64_t>(compute_units) * scratchpad_kb * 1024;
+    }
+    
+    std::string toString() const;
+    
+    // key = value text, one field per line; load throws on unknown keys
+    void save(const std::string& path) const;
+    static ChipConfig load(const std::string& path);
+};
+
+}
+}
@@ -1,43 +1,115 @@
 #pragma once
 
 #include "codegen/codegen.h"
+#include "simulator/chip_config.h"
+#include <algorithm>
+#include <map>
 #include <vector>
+#include <list>
+#include <unordered_map>
 
 namespace dlcompiler {
 namespace simulator {
 
-// hardware config
-struct ChipConfig {
-    int compute_units = 16; // num of parallel compute units
-    double memory_bandwidth_gb_s = 100; // mem bandwidth
-    int cache_size_kb = 256; // L1 cache size
-    int simd_width = 8; // SIMD vector width
-    double clock_freq_ghz = 1.5; // clock frequency
-    
-    std::string toString() const;
-};
-
 // execution stats
 struct ExecutionStats {
     int64_t cycles = 0;
     int64_t memory_accesses = 0;
-    int64_t cache_hits = 0;
-    int64_t cache_misses = 0;
+    int64_t cache_hits = 0; // L2 blocks found resident
+    int64_t cache_misses = 0; // L2 blocks fetched from DRAM
     double execution_time_ms = 0;
     double compute_utilization = 0;
     double memory_bound_time = 0;
+    int64_t compute_cycles = 0;
+    int64_t memory_cycles = 0;
+    
+    // weight traffic
+    int64_t weight_bytes_loaded = 0; // weight bytes fetched from mem
+    int64_t weight_bytes_reused = 0; // refetches avoided by weight-stationary reuse
+    int64_t weight_reuse_hits = 0; // weight loads served by the weight buffer
+    int64_t weight_buffer_spills = 0; // weights too large to stay stationary
+    int64_t prefetch_hidden_cycles = 0; // weight load cycles overlapped with compute
+    
+    // off-chip traffic and on-chip footprint
+    int64_t kernel_launches = 0; // nodes issuing compute
+    int64_t activation_bytes_loaded = 0; // DMA bytes into the scratchpads
+    int64_t memory_traffic_bytes = 0; // activation + weight bytes moved to/from mem
+    int64_t peak_sram_bytes = 0; // largest working set of a single compute
+    int64_t peak_working_set_bytes = 0; // largest untiled op, attention tiles are its floor
+    int64_t peak_activation_bytes = 0; // most activation memory live at once
+    
+    // conv lowering
+    std::map<std::string, int64_t> conv_algorithms; // algorithm -> layers using it
+    int64_t conv_cycles_saved = 0; // cost-model estimate against direct conv
+    
+    // pruned weights
+    std::map<std::string, int64_t> sparse_formats; // storage format -> ops using it
+    int64_t sparse_flops_skipped = 0; // dense flops not executed
+    int64_t sparse_index_bytes = 0; // sparse metadata fetched from mem
+    
+    // memory hierarchy
+    int64_t dma_transfers = 0;
+    int64_t scratchpad_bytes = 0; // DMA bytes into and out of the scratchpads
+    int64_t l2_bytes = 0; // DMA bytes served by or written into L2
+    int64_t l2_writeback_bytes = 0; // dirty L2 blocks evicted to DRAM
+    int64_t dram_bytes = 0; // every DRAM read and write, weights included
+    int64_t dram_row_hits = 0; // bursts to an already open row
+    int64_t dram_row_misses = 0;
+    int64_t dram_row_conflicts = 0; // misses closing another tensor's row
+    int64_t dma_hidden_cycles = 0; // async DMA overlapped with compute
+    int64_t l2_stall_cycles = 0; // exposed DMA time in L2
+    int64_t dram_stall_cycles = 0; // exposed DMA and weight time in DRAM
+    int64_t contention_cycles = 0; // blocking moves queued behind async ones
+    
+    // counters add up across instruction segments; peaks take the max and
+    // are left alone by -=
+    ExecutionStats& operator+=(const ExecutionStats& other);
+    ExecutionStats& operator-=(const ExecutionStats& other);
+    
+    // derive time and utilization from the counters
+    void finalize(double clock_freq_ghz);
     
     void print() const;
 };
 
-// simple cache model
+// LRU residency keyed by id, for data that stays on chip (stationary
+// weights, L2 blocks)
 class CacheModel {
 public:
-    CacheModel(int size_kb) : size_bytes_(size_kb * 1024) {}
+    CacheModel(int size_kb) : size_bytes_(static_cast<int64_t>(size_kb) * 1024) {}
     
-    bool access(int64_t address, int64_t size);
+    struct Entry {
+        int64_t key;
+        int64_t bytes;
+        bool dirty;
+        
+        bool operator==(const Entry& other) const {
+            return key == other.key && bytes == other.bytes && dirty == other.dirty;
+        }
+    };
+    
+    // occupancy and resident entries, hit/miss counters excluded
+    struct Snapshot {
+        int64_t usage = 0;
+        std::vector<Entry> resident;
+        
+        bool operator==(const Snapshot& other) const {
+            return usage == other.usage && resident == other.resident;
+        }
+    };
+    
+    // a miss allocates the entry, evicting least recently used ones; writes
+    // mark it dirty and dirty evictions are queued as write-backs
+    bool accessResident(int64_t key, int64_t size, bool write = false);
+    void invalidate(int64_t key); // drop without a write-back
+    std::vector<Entry> takeWritebacks();
     void reset();
     
+    Snapshot snapshot() const;
+    void restore(const Snapshot& snapshot);
+    
+    int64_t capacity() const { return size_bytes_; }
+    
     int64_t hits() const { return hits_; }
     int64_t misses() const { return misses_; }
     
@@ -46,26 +118,91 @@ private:
     int64_t current_usage_ = 0;
     int64_t hits_ = 0;
     int64_t misses_ = 0;
+    
+    std::list<Entry> lru_; // most recent first
+    std::unordered_map<int64_t, std::list<Entry>::iterator> resident_;
+    std::vector<Entry> writebacks_;
 };
 
 // simulator
 class Simulator {
 public:
-    Simulator(const ChipConfig& config) : config_(config), cache_(config.cache_size_kb) {}
+    Simulator(const ChipConfig& config) 
+        : config_(config), l2_(config.l2_size_kb), 
+          weight_buffer_(config.weight_buffer_kb),
+          open_rows_(static_cast<size_t>(std::max(config.dram_channels, 1) * 
+                                         std::max(config.dram_banks, 1)), -1),
+          row_owner_(open_rows_.size(), 0) {}
     
     ExecutionStats execute(const std::vector<codegen::Instruction>& instructions);
     
+    // state carried from one instruction segment into the next
+    struct State {
+        CacheModel::Snapshot l2;
+        CacheModel::Snapshot weight_buffer;
+        std::vector<int64_t> open_rows;
+        std::vector<int64_t> row_owner;
+        int64_t pending_prefetch = 0;
+        int64_t pending_l2 = 0;
+        int64_t pending_dram = 0;
+        int64_t live_activations = 0;
+        
+        int64_t pending() const { return pending_prefetch + pending_l2 + pending_dram; }
+        
+        bool operator==(const State& other) const {
+            return l2 == other.l2 && weight_buffer == other.weight_buffer &&
+                   open_rows == other.open_rows && row_owner == other.row_owner &&
+                   pending_prefetch == other.pending_prefetch &&
+                   pending_l2 == other.pending_l2 && pending_dram == other.pending_dram &&
+                   live_activations == other.live_activations;
+        }
+    };
+    
+    void reset();
+    State state() const;
+    void restore(const State& state);
+    
+    // continue from the current state; returns this segment's counters only
+    ExecutionStats simulateSegment(const std::vector<codegen::Instruction>& instructions);
+    
     const ChipConfig& config() const { return config_; }
     
 private:
-    int64_t simulateLoad(const codegen::Instruction& inst);
-    int64_t simulateStore(const codegen::Instruction& inst);
+    // bytes and row misses per DRAM channel for one transfer
+    struct ChannelLoad {
+        std::vector<int64_t> bytes;
+        std::vector<int64_t> misses;
+    };
+    
+    // cycles a move spends in each level
+    struct Transfer {
+        int64_t l2 = 0;
+        int64_t dram = 0;
+    };
+    
+    Transfer simulateDMA(const codegen::Instruction& inst, ExecutionStats& stats);
     int64_t simulateCompute(const codegen::Instruction& inst);
+    int64_t simulateWeightLoad(const codegen::Instruction& inst, ExecutionStats& stats);
+    
+    // blocking moves wait for queued async ones
+    int64_t drainQueue(ExecutionStats& stats);
+    
+    int64_t dramBase(int64_t tensor) const;
+    void walkDram(int64_t tensor, int64_t offset, int64_t bytes, ChannelLoad& load, 
+                  ExecutionStats& stats);
+    int64_t dramCycles(const ChannelLoad& load) const;
+    ChannelLoad channelLoad() const;
     
     ChipConfig config_;
-    CacheModel cache_;
+    CacheModel l2_;
+    CacheModel weight_buffer_;
+    std::vector<int64_t> open_rows_; // per channel x bank, -1 when closed
+    std::vector<int64_t> row_owner_; // tensor that opened the row
+    int64_t pending_prefetch_ = 0; // prefetch cycles not yet hidden behind compute
+    int64_t pending_l2_ = 0; // async DMA cycles not yet hidden, L2 part
+    int64_t pending_dram_ = 0; // and DRAM part
+    int64_t live_activations_ = 0; // activation bytes allocated and not yet freed
 };
 
 }
 }
-
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <iostream>
+
+namespace dlcompiler {
+
+// mutes std::cout for its lifetime; passes and codegen narrate every node,
+// which drowns trial compiles and large demo graphs
+class QuietStdout {
+public:
+    QuietStdout() : saved_(std::cout.rdbuf(nullptr)) {}
+    ~QuietStdout() { std::cout.rdbuf(saved_); }
+
+    QuietStdout(const QuietStdout&) = delete;
+    QuietStdout& operator=(const QuietStdout&) = delete;
+
+private:
+    std::streambuf* saved_;
+};
+
+}
@@ -1,10 +1,137 @@
 #include "codegen/codegen.h"
 #include <sstream>
 #include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace dlcompiler {
 namespace codegen {
 
+namespace {
+
+// output tile edge used to count how many tiles share one weight
+constexpr int64_t kSpatialTile = 8;
+constexpr int64_t kRowTile = 8;
+
+// query rows / key columns per fused attention tile
+constexpr int64_t kAttentionTile = 64;
+
+// direct conv loops get less register reuse than a blocked GEMM
+constexpr double kDirectConvEfficiency = 0.7;
+// complex arithmetic and bit-reversed access in FFT conv
+constexpr double kFFTConvEfficiency = 0.5;
+
+// F(4x4, 3x3): 6x6 input tiles, flops per tile per channel with dense
+// transform matrices (an upper bound)
+constexpr int64_t kWinogradTile = 6;
+constexpr int64_t kWinogradOut = 4;
+constexpr int64_t kWinogradInputTransform = 2 * 2 * 6 * 6 * 6;
+constexpr int64_t kWinogradOutputTransform = 2 * (4 * 6 * 6 + 4 * 6 * 4);
+
+// sparse kernels against the dense one: software n:m decodes fixed-size
+// groups, block kernels run dense micro-tiles once a block fills them
+constexpr double kSoftwareNofMEfficiency = 0.5;
+constexpr double kBlockSparseEfficiency = 0.9;
+constexpr int64_t kBlockFullTile = 32; // block elements for full micro-tile reuse
+constexpr int64_t kIndexBytes = 4; // row pointers, block column ids
+
+int64_t ceilDiv(int64_t a, int64_t b) {
+    return (a + b - 1) / b;
+}
+
+int64_t nextPow2(int64_t x) {
+    int64_t p = 1;
+    while (p < x) p <<= 1;
+    return p;
+}
+
+bool isConv(const ir::Node* node) {
+    return node->type() == ir::OpType::CONV2D || node->type() == ir::OpType::FUSED_CONV_RELU;
+}
+
+bool isMatMul(const ir::Node* node) {
+    return node->type() == ir::OpType::MATMUL || node->type() == ir::OpType::FUSED_MATMUL_ADD;
+}
+
+// pruning metadata only matters on a constant weight operand
+bool hasSparseWeight(const ir::Node* node) {
+    return (isConv(node) || isMatMul(node)) && node->inputs().size() > 1 &&
+           node->inputs()[1]->isConstant() && !node->sparsity().isDense();
+}
+
+// calibrated correction for kernel classes the cost model can't see into
+double calibratedEfficiency(const ir::Node* node, const simulator::ChipConfig& target) {
+    if (isConv(node)) return target.conv_efficiency;
+    if (isMatMul(node) || node->type() == ir::OpType::FUSED_ATTENTION) {
+        return target.matmul_efficiency;
+    }
+    return 1.0;
+}
+
+int64_t denseMatMulFLOPs(const ir::Node* node) {
+    // flops = 2 * batch * M * N * K
+    const auto& a = node->inputs()[0]->shape();
+    int64_t out = node->outputs()[0]->shape().numel();
+    int64_t k = a.dims[a.rank() - 1];
+    int64_t flops = 2 * out * k;
+    
+    // fused bias-add epilogue
+    if (node->type() == ir::OpType::FUSED_MATMUL_ADD) {
+        flops += out;
+    }
+    return flops;
+}
+
+bool readsValue(const ir::Node* node, const ir::Value* value) {
+    if (!node) return false;
+    for (auto* input : node->inputs()) {
+        if (input == value) return true;
+    }
+    return false;
+}
+
+}
+
+std::string SparseLowering::toString() const {
+    std::stringstream ss;
+    ss << format;
+    if (format != "dense") ss << (skips_zeros ? " kernel" : " expanded on chip");
+    ss << ", " << value_bytes / 1024 << " KB values + " << index_bytes / 1024 << " KB index";
+    return ss.str();
+}
+
+std::string convAlgorithmToString(ConvAlgorithm algorithm) {
+    switch (algorithm) {
+        case ConvAlgorithm::DIRECT: return "direct";
+        case ConvAlgorithm::IM2COL_GEMM: return "im2col-gemm";
+        case ConvAlgorithm::WINOGRAD: return "winograd";
+        case ConvAlgorithm::FFT: return "fft";
+        default: return "unknown";
+    }
+}
+
+std::string memoryLevelToString(MemoryLevel level) {
+    switch (level) {
+        case MemoryLevel::SCRATCHPAD: return "scratchpad";
+        case MemoryLevel::L2: return "l2";
+        case MemoryLevel::DRAM: return "dram";
+        default: return "unknown";
+    }
+}
+
+bool CodeGenerator::isComputeNode(const ir::Node* node) {
+    // reshape and split are views and move no data; the producer of a split
+    // writes each slice where its consumer reads it
+    return node->type() != ir::OpType::INPUT &&
+           node->type() != ir::OpType::OUTPUT &&
+           node->type() != ir::OpType::CONSTANT &&
+           node->type() != ir::OpType::RESHAPE &&
+           node->type() != ir::OpType::SPLIT;
+}
+
 std::string Instruction::toString() const {
     std::stringstream ss;
     ss << "Instruction{";
@@ -13,22 +140,67 @@ std::string Instruction::toString() const {
         case InstructionType::STORE: ss << "STORE"; break;
         case InstructionType::COMPUTE: ss << "COMPUTE"; break;
         case InstructionType::SYNC: ss << "SYNC"; break;
+        case InstructionType::PREFETCH: ss << "PREFETCH"; break;
+        case InstructionType::DMA: ss << "DMA"; break;
     }
     ss << ", op=" << op_name;
     ss << ", in=" << input_size << "B";
     ss << ", out=" << output_size << "B";
-    ss << ", flops=" << flops << "}";
+    ss << ", flops=" << flops;
+    if (is_weight) {
+        ss << ", weight=v" << value_id << ", reuse=" << reuse;
+    }
+    if (type == InstructionType::DMA) {
+        ss << ", " << memoryLevelToString(src) << "->" << memoryLevelToString(dst) 
+           << " v" << value_id << "+" << offset;
+        if (async) ss << ", async";
+    }
+    ss << "}";
     return ss.str();
 }
 
 std::vector<Instruction> CodeGenerator::generate(ir::Graph* graph) {
+    if (!graph->isStatic()) {
+        throw std::runtime_error("codegen needs static shapes, specialize the graph first");
+    }
+    
     std::vector<Instruction> instructions;
+    conv_choices_.clear();
     
     std::cout << "\n ----> Code Generation <----\n";
     
     auto nodes = graph->getNodesInTopoOrder();
+    auto liveness = analyzeLiveness(nodes);
+    ir::Node* prev_compute = nullptr;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        // next layer's weights get prefetched behind this layer's compute
+        ir::Node* next_compute = nullptr;
+        for (size_t j = i + 1; j < nodes.size(); ++j) {
+            if (isComputeNode(nodes[j])) {
+                next_compute = nodes[j];
+                break;
+            }
+        }
+        size_t first = instructions.size();
+        generateForNode(nodes[i], prev_compute, next_compute, instructions);
+        annotateLiveness(nodes[i], liveness, instructions, first);
+        if (isComputeNode(nodes[i])) prev_compute = nodes[i];
+    }
+    
     for (auto* node : nodes) {
-        generateForNode(node, instructions);
+        if (!isConv(node)) continue;
+        const auto& choice = convChoice(node);
+        std::cout << "  Node" << node->id() << " " << ir::opTypeToString(node->type()) << " "
+                  << node->getAttr("kernel_size", 3) << "x" << node->getAttr("kernel_size", 3)
+                  << "/" << node->getAttr("stride", 1) << ": " 
+                  << convAlgorithmToString(choice.algorithm) << ", ~" << choice.cycles_saved 
+                  << " cycles saved vs direct\n";
+    }
+    
+    for (auto* node : nodes) {
+        if (!hasSparseWeight(node)) continue;
+        std::cout << "  Node" << node->id() << " " << ir::opTypeToString(node->type()) << " "
+                  << node->sparsity().toString() << ": " << selectSparseLowering(node).toString() << "\n";
     }
     
     std::cout << "Generated " << instructions.size() << " instructions\n";
@@ -37,77 +209,757 @@ std::vector<Instruction> CodeGenerator::generate(ir::Graph* graph) {
     return instructions;
 }
 
-void CodeGenerator::generateForNode(ir::Node* node, std::vector<Instruction>& instructions) {
-    // skip in and out nodes
-    if (node->type() == ir::OpType::INPUT || node->type() == ir::OpType::OUTPUT) {
+void CodeGenerator::generateForNode(ir::Node* node, ir::Node* prev_compute, 
+                                    ir::Node* next_compute,
+                                    std::vector<Instruction>& instructions) {
+    // skip in, out and constant nodes; weights are loaded by their consumers
+    if (!isComputeNode(node)) {
         return;
     }
     
-    // calc i/o sizes
-    int64_t input_size = 0;
+    int64_t weight_size = 0;
+    for (auto* input : node->inputs()) {
+        if (input->isConstant()) weight_size += weightBytes(node, input);
+    }
+    
+    size_t first = instructions.size();
+    
+    // gen weight LOADs not already in flight from the previous node's prefetch
+    int64_t reuse = weightReuse(node);
     for (auto* input : node->inputs()) {
-        input_size += input->shape().numel() * sizeof(float);
+        if (!input->isConstant()) continue;
+        if (prev_compute && !readsValue(prev_compute, input)) continue;
+        
+        Instruction load{
+            InstructionType::LOAD,
+            ir::opTypeToString(node->type()),
+            weightBytes(node, input),
+            0,
+            0
+        };
+        load.value_id = input->id();
+        load.is_weight = true;
+        load.reuse = reuse;
+        load.index_bytes = indexBytes(node, input);
+        instructions.push_back(load);
+    }
+    
+    // gen PREFETCH for the next layer's weights
+    std::vector<Instruction> prefetches;
+    if (next_compute) {
+        int64_t next_reuse = weightReuse(next_compute);
+        for (auto* input : next_compute->inputs()) {
+            if (!input->isConstant() || readsValue(node, input)) continue;
+            
+            Instruction prefetch{
+                InstructionType::PREFETCH,
+                ir::opTypeToString(next_compute->type()),
+                weightBytes(next_compute, input),
+                0,
+                0
+            };
+            prefetch.value_id = input->id();
+            prefetch.is_weight = true;
+            prefetch.reuse = next_reuse;
+            prefetch.index_bytes = indexBytes(next_compute, input);
+            prefetches.push_back(prefetch);
+        }
     }
     
+    if (node->type() == ir::OpType::FUSED_ATTENTION) {
+        generateAttention(node, prefetches, instructions);
+    } else {
+        generateTiles(node, weight_size, prefetches, instructions);
+    }
+    
+    for (size_t i = first; i < instructions.size(); ++i) {
+        instructions[i].node_id = node->id();
+    }
+}
+
+void CodeGenerator::generateTiles(ir::Node* node, int64_t weight_size,
+                                  const std::vector<Instruction>& prefetches,
+                                  std::vector<Instruction>& instructions) {
+    std::string op = ir::opTypeToString(node->type());
+    const auto& out = node->outputs()[0]->shape();
     int64_t output_size = 0;
     for (auto* output : node->outputs()) {
-        output_size += output->shape().numel() * sizeof(float);
+        output_size += output->bytes();
     }
     
-    // gen LOAD instruction
-    instructions.push_back({
-        InstructionType::LOAD,
-        ir::opTypeToString(node->type()),
-        input_size,
-        0,
-        0
-    });
+    ConvCost conv;
+    int64_t scratch = 0;
+    if (isConv(node)) {
+        conv = convChoice(node);
+        if (conv.transform_bytes == 0) scratch = conv.workspace_bytes;
+    }
+    
+    // activation operands are either cut with the output rows or needed
+    // whole by every tile (matmul rhs, broadcast add operands)
+    struct Operand {
+        const ir::Value* value;
+        bool whole;
+        int64_t window = 1; // input rows read per output row window, convs and pools
+        int64_t stride = 1;
+    };
+    std::vector<Operand> operands;
+    int64_t split_bytes = 0;
+    int64_t whole_bytes = 0;
+    for (size_t i = 0; i < node->inputs().size(); ++i) {
+        auto* input = node->inputs()[i];
+        if (input->isConstant()) continue;
+        
+        Operand operand{input, false};
+        if (isMatMul(node)) {
+            operand.whole = i > 0 && (i == 1 || input->shape().numel() < out.numel());
+        } else if (node->type() == ir::OpType::ADD) {
+            operand.whole = input->shape().numel() < out.numel();
+        } else if (i == 0 && (isConv(node) || node->type() == ir::OpType::MAXPOOL)) {
+            operand.window = node->getAttr("kernel_size", isConv(node) ? 3 : 2);
+            operand.stride = node->getAttr("stride", isConv(node) ? 1 : 2);
+        }
+        (operand.whole ? whole_bytes : split_bytes) += input->bytes();
+        operands.push_back(operand);
+    }
+    
+    // double buffering leaves half the scratchpad to each tile; whole
+    // operands stay resident when they fit in half of that
+    int64_t budget = std::max<int64_t>(target_.scratchpadBytes() / 2, 1);
+    bool resident = whole_bytes <= budget / 2;
+    int64_t room = std::max<int64_t>(budget - (resident ? whole_bytes : 0), 1);
+    int64_t rows = std::max<int64_t>(out.numel() / std::max<int64_t>(out.dims.back(), 1), 1);
+    int64_t tiles = std::min(rows, std::max<int64_t>(1, ceilDiv(split_bytes + output_size + scratch, room)));
+    
+    // NCHW windows: each tile reads its rows plus the halo from every channel plane
+    int64_t out_rows = out.rank() == 4 ? out.dims[0] * out.dims[2] : rows;
+    int64_t tile_rows = ceilDiv(out_rows, tiles);
+    auto tileIn = [&](const Operand& o, int64_t t, Instruction& move) {
+        int64_t bytes = o.value->bytes();
+        if (o.whole) return bytes;
+        int64_t slice = ceilDiv(bytes, tiles);
+        move.offset = std::min(bytes, bytes * t / tiles);
+        if (o.window == 1) return std::min(slice, bytes - move.offset);
+        
+        double halo = static_cast<double>((tile_rows - 1) * o.stride + o.window) / (tile_rows * o.stride);
+        const auto& in = o.value->shape();
+        if (in.rank() == 4 && !node->getAttr("layout_nhwc") && tile_rows < out.dims[2]) {
+            int64_t in_rows = std::min(in.dims[2], (tile_rows - 1) * o.stride + o.window);
+            move.run_bytes = in_rows * in.dims[3] * o.value->elemBytes();
+            move.run_stride = in.dims[2] * in.dims[3] * o.value->elemBytes();
+            move.offset = (t * tile_rows * o.stride % in.dims[2]) * in.dims[3] * o.value->elemBytes();
+        }
+        return std::min(bytes, static_cast<int64_t>(slice * halo));
+    };
+    
+    // inbound moves of tile t, returns the bytes it reads
+    auto load = [&](int64_t t, bool async) {
+        int64_t bytes = 0;
+        for (const auto& o : operands) {
+            bool again = o.whole && resident && t > 0;
+            Instruction move = dma(node, o.value, true, 0, 0);
+            int64_t moved = tileIn(o, t, move);
+            placeInStorage(move, o.value);
+            bytes += moved;
+            if (again) continue;
+            move.input_size = moved;
+            move.async = async;
+            instructions.push_back(move);
+        }
+        return bytes;
+    };
     
-    // gen COMPUTE instruction
     int64_t flops = computeFLOPs(node);
-    instructions.push_back({
-        InstructionType::COMPUTE,
-        ir::opTypeToString(node->type()),
-        input_size,
-        output_size,
-        flops
+    int64_t ws_key = -2 - node->id(); // spilled workspace, not an IR value
+    MemoryLevel ws_level = conv.workspace_bytes <= target_.l2_size_kb * 1024 / 2 ? MemoryLevel::L2 
+                                                                                 : MemoryLevel::DRAM;
+    
+    int64_t in_bytes = load(0, false);
+    instructions.insert(instructions.end(), prefetches.begin(), prefetches.end());
+    
+    for (int64_t t = 0; t < tiles; ++t) {
+        // software pipeline: the next tile streams in behind this compute
+        int64_t next_bytes = t + 1 < tiles ? load(t + 1, true) : 0;
+        
+        int64_t tile_out = output_size * (t + 1) / tiles - output_size * t / tiles;
+        if (conv.transform_bytes > 0) {
+            // workspace spills the scratchpad: written out and read back
+            int64_t ws = conv.workspace_bytes * (t + 1) / tiles - conv.workspace_bytes * t / tiles;
+            Instruction spill{InstructionType::DMA, op, 0, ws, 0};
+            spill.value_id = static_cast<int>(ws_key);
+            spill.src = MemoryLevel::SCRATCHPAD;
+            spill.dst = ws_level;
+            spill.offset = conv.workspace_bytes * t / tiles;
+            Instruction fill = spill;
+            fill.input_size = ws;
+            fill.output_size = 0;
+            fill.src = ws_level;
+            fill.dst = MemoryLevel::SCRATCHPAD;
+            instructions.push_back(spill);
+            instructions.push_back(fill);
+        }
+        
+        Instruction compute{InstructionType::COMPUTE, op, in_bytes + weight_size, tile_out,
+                            flops * (t + 1) / tiles - flops * t / tiles};
+        compute.scratch_bytes = scratch * (t + 1) / tiles - scratch * t / tiles;
+        if (t == 0) {
+            compute.working_set_bytes = split_bytes + whole_bytes + weight_size + output_size + scratch;
+        }
+        if (isConv(node)) {
+            compute.efficiency = conv.efficiency;
+            if (t == 0) {
+                compute.algorithm = convAlgorithmToString(conv.algorithm);
+                compute.cycles_saved = conv.cycles_saved;
+            }
+        }
+        if (hasSparseWeight(node)) {
+            auto sparse = selectSparseLowering(node);
+            if (!isConv(node)) compute.efficiency = sparse.efficiency; // convs fold it in above
+            if (t == 0) {
+                // winograd / fft transform the filters dense, nothing is expanded
+                bool expanded = sparse.format != "dense" && !sparse.skips_zeros;
+                compute.sparse_format = sparse.format + (expanded ? " expanded" : "");
+                compute.flops_skipped = sparse.flops_skipped;
+            }
+        }
+        compute.efficiency *= calibratedEfficiency(node, target_);
+        instructions.push_back(compute);
+        
+        // results drain behind the next compute
+        for (auto* output : node->outputs()) {
+            int64_t bytes = output->bytes();
+            auto move = dma(node, output, false, bytes * (t + 1) / tiles - bytes * t / tiles, 
+                            bytes * t / tiles);
+            move.async = true;
+            instructions.push_back(move);
+        }
+        in_bytes = next_bytes;
+    }
+}
+
+MemoryLevel CodeGenerator::homeLevel(const ir::Value* value) const {
+    // graph inputs arrive in DRAM; activations stay in L2 unless they would
+    // flush most of it
+    const auto* storage = value->storage();
+    if (!storage->producer() || !isComputeNode(storage->producer())) return MemoryLevel::DRAM;
+    return storage->bytes() <= target_.l2_size_kb * 1024 / 2 ? MemoryLevel::L2 : MemoryLevel::DRAM;
+}
+
+Instruction CodeGenerator::dma(ir::Node* node, const ir::Value* value, bool inbound, 
+                               int64_t bytes, int64_t offset) const {
+    const auto* storage = value->storage();
+    Instruction move{InstructionType::DMA, ir::opTypeToString(node->type()), 
+                     inbound ? bytes : 0, inbound ? 0 : bytes, 0};
+    move.value_id = storage->id();
+    move.src = inbound ? homeLevel(storage) : MemoryLevel::SCRATCHPAD;
+    move.dst = inbound ? MemoryLevel::SCRATCHPAD : homeLevel(storage);
+    move.offset = offset;
+    return move;
+}
+
+void CodeGenerator::placeInStorage(Instruction& move, const ir::Value* value) {
+    // move was addressed within value; a split piece is a band of the wide
+    // tensor along axis, so each outer row of the piece is one run of the
+    // wide rows, starting at the piece's base
+    for (const auto* piece = value; piece->producer(); piece = piece->producer()->inputs()[0]) {
+        auto* split = piece->producer();
+        if (split->type() == ir::OpType::RESHAPE) continue;
+        if (split->type() != ir::OpType::SPLIT) break;
+        
+        const auto& wide = split->inputs()[0]->shape();
+        int64_t axis = split->getAttr("axis");
+        int64_t outer = 1;
+        int64_t inner = piece->elemBytes();
+        for (int64_t d = 0; d < axis; ++d) outer *= wide.dims[d];
+        for (size_t d = axis + 1; d < wide.rank(); ++d) inner *= wide.dims[d];
+        
+        int64_t base = 0;
+        size_t i = 0;
+        for (; split->outputs()[i] != piece; ++i) {
+            base += split->getAttr("size_" + std::to_string(i)) * inner;
+        }
+        int64_t row = split->getAttr("size_" + std::to_string(i)) * inner;
+        int64_t wide_row = wide.dims[axis] * inner;
+        
+        int64_t col = move.offset % row;
+        if (outer > 1) {
+            if (move.run_bytes > 0 && move.run_stride % row == 0 && col + move.run_bytes <= row) {
+                move.run_stride = move.run_stride / row * wide_row; // runs already within rows
+            } else {
+                move.run_bytes = move.run_bytes > 0 ? std::min(move.run_bytes, row) : row;
+                move.run_stride = wide_row;
+            }
+        }
+        move.offset = move.offset / row * wide_row + base + col;
+    }
+}
+
+Liveness CodeGenerator::analyzeLiveness(const std::vector<ir::Node*>& nodes) {
+    // an activation is live from its producer's compute to the last compute
+    // reading it (or a reshape view of it); graph outputs are never freed
+    Liveness liveness;
+    for (auto* node : nodes) {
+        for (auto* input : node->inputs()) {
+            const auto* storage = input->storage();
+            if (node->type() == ir::OpType::OUTPUT) liveness.pinned.insert(storage);
+            if (isComputeNode(node)) liveness.last_reader[storage] = node;
+        }
+    }
+    for (const auto& entry : liveness.last_reader) {
+        liveness.reader_of[entry.first->id()] = entry.second->id();
+    }
+    for (const auto* value : liveness.pinned) {
+        liveness.output_ids.insert(value->id());
+    }
+    return liveness;
+}
+
+void CodeGenerator::annotateLiveness(const ir::Node* node, const Liveness& liveness,
+                                     std::vector<Instruction>& instructions, size_t first) const {
+    if (!isComputeNode(node)) return;
+    
+    int64_t alloc = 0;
+    int64_t freed = 0;
+    for (auto* output : node->outputs()) {
+        alloc += output->bytes();
+        // dead outputs go away right after being written
+        if (!liveness.last_reader.count(output) && !liveness.pinned.count(output)) {
+            freed += output->bytes();
+        }
+    }
+    std::unordered_set<const ir::Value*> released;
+    for (auto* input : node->inputs()) {
+        const auto* value = input->storage();
+        auto it = liveness.last_reader.find(value);
+        if (it == liveness.last_reader.end() || it->second != node || 
+            liveness.pinned.count(value) || !value->producer() || 
+            !isComputeNode(value->producer())) {
+            continue;
+        }
+        if (released.insert(value).second) freed += value->bytes();
+    }
+    
+    // allocate at the node's first COMPUTE, free after its last; dead tensors
+    // leave L2 without a write-back, graph outputs go to DRAM
+    size_t last_compute = instructions.size();
+    std::unordered_map<int, size_t> last_read;
+    for (size_t i = first; i < instructions.size(); ++i) {
+        auto& inst = instructions[i];
+        if (inst.type == InstructionType::COMPUTE && inst.node_id == node->id()) {
+            if (last_compute == instructions.size()) inst.alloc_bytes = alloc;
+            last_compute = i;
+        }
+        if (inst.type != InstructionType::DMA || inst.value_id < 0) continue;
+        if (liveness.output_ids.count(inst.value_id)) {
+            (inst.dst == MemoryLevel::SCRATCHPAD ? inst.src : inst.dst) = MemoryLevel::DRAM;
+        }
+        auto it = liveness.reader_of.find(inst.value_id);
+        if (inst.dst == MemoryLevel::SCRATCHPAD && it != liveness.reader_of.end() && 
+            it->second == inst.node_id) {
+            last_read[inst.value_id] = i;
+        }
+    }
+    if (last_compute < instructions.size()) instructions[last_compute].free_bytes = freed;
+    for (const auto& entry : last_read) {
+        if (!liveness.output_ids.count(entry.first)) instructions[entry.second].last_use = true;
+    }
+}
+
+void CodeGenerator::generateAttention(ir::Node* node, const std::vector<Instruction>& prefetches,
+                                      std::vector<Instruction>& instructions) {
+    // flash-attention schedule: stream K/V tiles past a resident Q tile with
+    // an online softmax, so the S x S_kv score matrix only ever exists one
+    // Br x Bc tile at a time
+    const auto& q = node->inputs()[0]->shape();
+    const auto& k = node->inputs()[1]->shape();
+    const auto& v = node->inputs()[2]->shape();
+    int64_t s = q.dims[q.rank() - 2];
+    int64_t d = q.dims[q.rank() - 1];
+    int64_t s_kv = k.dims[k.rank() - 2];
+    int64_t d_v = v.dims[v.rank() - 1];
+    int64_t heads = q.numel() / (s * d); // batch x heads
+    int64_t elem = sizeof(float);
+    std::string op = ir::opTypeToString(node->type());
+    
+    // rows [row, row + count) of every head: one run per head
+    auto slice = [&](const ir::Value* value, bool inbound, int64_t row, int64_t count, 
+                     int64_t seq, int64_t width) {
+        auto move = dma(node, value, inbound, heads * count * width * elem, row * width * elem);
+        move.run_bytes = count * width * elem;
+        move.run_stride = seq * width * elem;
+        placeInStorage(move, value);
+        return move;
+    };
+    
+    std::vector<std::pair<int64_t, int64_t>> steps; // (q row, kv row)
+    for (int64_t i = 0; i < s; i += kAttentionTile) {
+        for (int64_t j = 0; j < s_kv; j += kAttentionTile) {
+            steps.push_back({i, j});
+        }
+    }
+    
+    // Q_i with the first K/V tile, then K_j / V_j on their own
+    auto load = [&](size_t step, bool async) {
+        int64_t i = steps[step].first;
+        int64_t j = steps[step].second;
+        std::vector<Instruction> moves;
+        if (j == 0) moves.push_back(slice(node->inputs()[0], true, i, std::min(kAttentionTile, s - i), s, d));
+        int64_t cols = std::min(kAttentionTile, s_kv - j);
+        moves.push_back(slice(node->inputs()[1], true, j, cols, s_kv, d));
+        moves.push_back(slice(node->inputs()[2], true, j, cols, s_kv, d_v));
+        for (auto& move : moves) {
+            move.async = async;
+            instructions.push_back(move);
+        }
+    };
+    
+    load(0, false);
+    instructions.insert(instructions.end(), prefetches.begin(), prefetches.end());
+    
+    for (size_t step = 0; step < steps.size(); ++step) {
+        if (step + 1 < steps.size()) load(step + 1, true);
+        
+        int64_t i = steps[step].first;
+        int64_t j = steps[step].second;
+        int64_t rows = std::min(kAttentionTile, s - i);
+        int64_t cols = std::min(kAttentionTile, s_kv - j);
+        int64_t q_bytes = heads * rows * d * elem;
+        int64_t o_bytes = heads * rows * d_v * elem;
+        int64_t k_bytes = heads * cols * d * elem;
+        int64_t v_bytes = heads * cols * d_v * elem;
+        
+        // S_ij = Q_i K_j^T, online softmax, O_i += P_ij V_j
+        int64_t flops = heads * (2 * rows * cols * d + 5 * rows * cols + 2 * rows * cols * d_v);
+        Instruction compute{InstructionType::COMPUTE, op, q_bytes + k_bytes + v_bytes, 
+                            o_bytes, flops};
+        compute.scratch_bytes = heads * (rows * cols + 2 * rows) * elem; // scores + row max/sum
+        compute.working_set_bytes = compute.input_size + compute.output_size + compute.scratch_bytes;
+        compute.efficiency = calibratedEfficiency(node, target_);
+        instructions.push_back(compute);
+        
+        if (j + kAttentionTile >= s_kv) {
+            auto store = slice(node->outputs()[0], false, i, rows, s, d_v);
+            store.async = true;
+            instructions.push_back(store);
+        }
+    }
+}
+
+std::vector<ConvCost> CodeGenerator::convCandidates(const ir::Node* node) const {
+    const auto& in = node->inputs()[0]->shape();
+    const auto& out = node->outputs()[0]->shape();
+    int64_t n = out.dims[0];
+    int64_t c_in = in.dims[1];
+    int64_t h = in.dims[2];
+    int64_t w = in.dims[3];
+    int64_t c_out = out.dims[1];
+    int64_t h_out = out.dims[2];
+    int64_t w_out = out.dims[3];
+    int64_t k = node->getAttr("kernel_size", 3);
+    int64_t stride = node->getAttr("stride", 1);
+    int64_t pad = node->getAttr("padding", 0);
+    int64_t elem = node->outputs()[0]->elemBytes();
+    int64_t epilogue = node->type() == ir::OpType::FUSED_CONV_RELU ? out.numel() : 0;
+    int64_t macs = n * c_out * h_out * w_out * c_in * k * k;
+    
+    // share of SIMD lanes doing useful work when vectorizing over width
+    auto lanes = [&](int64_t width) {
+        int64_t simd = std::max(target_.simd_width, 1);
+        return static_cast<double>(width) / (ceilDiv(width, simd) * simd);
+    };
+    
+    std::vector<ConvCost> candidates;
+    
+    ConvCost direct;
+    direct.algorithm = ConvAlgorithm::DIRECT;
+    direct.flops = 2 * macs + epilogue;
+    direct.weight_bytes = c_out * c_in * k * k * elem;
+    direct.efficiency = kDirectConvEfficiency * lanes(w_out) * (stride > 1 ? 0.5 : 1.0);
+    
+    // pruned filters stay pruned in the spatial domain only
+    auto prune = [&](ConvCost& c) {
+        c.sparse = sparseCandidates(node, c.flops, c.efficiency).front();
+        c.flops = static_cast<int64_t>(c.flops * c.sparse.flop_scale) + c.sparse.decode_flops;
+        c.efficiency *= c.sparse.efficiency;
+        c.weight_bytes = c.sparse.value_bytes + c.sparse.index_bytes;
+    };
+    prune(direct);
+    candidates.push_back(direct);
+    
+    // 1x1 stride-1 convs need no unfolding and are plain GEMMs
+    ConvCost gemm;
+    gemm.algorithm = ConvAlgorithm::IM2COL_GEMM;
+    gemm.flops = 2 * macs + epilogue;
+    bool pointwise = k == 1 && stride == 1 && pad == 0;
+    gemm.workspace_bytes = pointwise ? 0 : n * h_out * w_out * c_in * k * k * elem;
+    gemm.weight_bytes = direct.weight_bytes;
+    gemm.efficiency = lanes(c_out);
+    prune(gemm);
+    candidates.push_back(gemm);
+    
+    if (k == 3 && stride == 1) {
+        // 36 multiplies per 4x4 output tile instead of 144, filters pre-transformed
+        int64_t tiles = n * ceilDiv(h_out, kWinogradOut) * ceilDiv(w_out, kWinogradOut);
+        int64_t points = kWinogradTile * kWinogradTile;
+        ConvCost winograd;
+        winograd.algorithm = ConvAlgorithm::WINOGRAD;
+        winograd.flops = 2 * points * tiles * c_in * c_out + tiles * c_in * kWinogradInputTransform +
+                         tiles * c_out * kWinogradOutputTransform + epilogue;
+        winograd.workspace_bytes = points * tiles * (c_in + c_out) * elem;
+        winograd.weight_bytes = c_out * c_in * points * elem;
+        winograd.efficiency = lanes(c_out);
+        winograd.sparse.value_bytes = winograd.weight_bytes;
+        candidates.push_back(winograd);
+    }
+    
+    if (k > 1 && stride == 1) {
+        // real FFTs of the padded planes, complex products over half spectra
+        int64_t fh = nextPow2(h + 2 * pad);
+        int64_t fw = nextPow2(w + 2 * pad);
+        int64_t plane = fh * fw;
+        int64_t bins = fh * (fw / 2 + 1);
+        int64_t log_plane = 0;
+        while ((int64_t(1) << log_plane) < plane) log_plane++;
+        
+        ConvCost fft;
+        fft.algorithm = ConvAlgorithm::FFT;
+        fft.flops = n * (c_in + c_out) * plane * log_plane * 5 / 2 + 8 * n * c_in * c_out * bins + 
+                    epilogue;
+        fft.workspace_bytes = n * (c_in + c_out) * bins * 2 * elem;
+        fft.weight_bytes = c_out * c_in * bins * 2 * elem;
+        fft.efficiency = kFFTConvEfficiency * lanes(c_out);
+        fft.sparse.value_bytes = fft.weight_bytes;
+        candidates.push_back(fft);
+    }
+    
+    // weight and spilled workspace traffic on top of compute
+    int64_t scratchpad = target_.scratchpadBytes();
+    for (auto& c : candidates) {
+        c.transform_bytes = c.workspace_bytes > scratchpad ? 2 * c.workspace_bytes : 0;
+        c.cycles = estimateCycles(c.flops, c.efficiency, c.weight_bytes + c.transform_bytes);
+    }
+    for (auto& c : candidates) {
+        c.cycles_saved = candidates[0].cycles - c.cycles;
+    }
+    
+    std::stable_sort(candidates.begin(), candidates.end(), [](const ConvCost& a, const ConvCost& b) {
+        return a.cycles < b.cycles;
     });
+    return candidates;
+}
+
+ConvCost CodeGenerator::selectConvAlgorithm(const ir::Node* node) const {
+    auto candidates = convCandidates(node);
+    if (force_conv_) {
+        for (const auto& c : candidates) {
+            if (c.algorithm == forced_conv_) return c;
+        }
+    }
+    return candidates.front();
+}
+
+const ConvCost& CodeGenerator::convChoice(const ir::Node* node) const {
+    auto it = conv_choices_.find(node->id());
+    if (it == conv_choices_.end()) {
+        it = conv_choices_.emplace(node->id(), selectConvAlgorithm(node)).first;
+    }
+    return it->second;
+}
+
+std::vector<SparseLowering> CodeGenerator::sparseCandidates(const ir::Node* node, 
+                                                            int64_t dense_flops,
+                                                            double dense_efficiency) const {
+    const auto* weight = node->inputs()[1];
+    int64_t elem = weight->elemBytes();
+    int64_t numel = weight->shape().numel();
+    int64_t rows = isConv(node) ? weight->shape().dims[0] : weight->shape().dims.back();
+    int64_t cols = numel / std::max<int64_t>(rows, 1); // reduction axis
+    auto sparsity = weight->isConstant() ? node->sparsity() : ir::Sparsity();
+    
+    std::vector<SparseLowering> candidates;
+    SparseLowering dense;
+    dense.value_bytes = numel * elem;
+    candidates.push_back(dense);
+    
+    // n:m groups run along the reduction axis; a ragged tail has no packed
+    // form, so those weights lower dense
+    bool ragged = sparsity.pattern == ir::SparsityPattern::N_OF_M && cols % sparsity.m != 0;
+    if (!sparsity.isDense() && !ragged) {
+        SparseLowering packed;
+        packed.skips_zeros = true;
+        switch (sparsity.pattern) {
+            case ir::SparsityPattern::N_OF_M: {
+                // a native n:m datapath runs sparser groups at its own ratio
+                bool native = target_.sparse_m == sparsity.m && sparsity.n <= target_.sparse_n;
+                int64_t n = native ? target_.sparse_n : sparsity.n;
+                int64_t kept = numel / sparsity.m * n;
+                int64_t bits = 0;
+                while ((int64_t(1) << bits) < sparsity.m) bits++;
+                
+                packed.format = std::to_string(n) + ":" + std::to_string(sparsity.m);
+                packed.value_bytes = kept * elem;
+                packed.index_bytes = ceilDiv(kept * bits, 8); // position within each group
+                packed.flop_scale = static_cast<double>(kept) / numel;
+                packed.efficiency = native ? 1.0 : kSoftwareNofMEfficiency;
+                break;
+            }
+            
+            case ir::SparsityPattern::BLOCK: {
+                // block-compressed rows: column id per kept block plus row pointers
+                int64_t block_rows = ceilDiv(rows, sparsity.block_rows);
+                int64_t blocks = block_rows * ceilDiv(cols, sparsity.block_cols);
+                int64_t kept = static_cast<int64_t>(std::ceil(blocks * sparsity.density));
+                int64_t block = sparsity.block_rows * sparsity.block_cols;
+                double fill = std::min(1.0, static_cast<double>(block) / kBlockFullTile);
+                
+                packed.format = "bsr " + std::to_string(sparsity.block_rows) + "x" + 
+                                std::to_string(sparsity.block_cols);
+                packed.value_bytes = kept * block * elem;
+                packed.index_bytes = (kept + block_rows + 1) * kIndexBytes;
+                packed.flop_scale = std::min(1.0, static_cast<double>(kept * block) / numel);
+                packed.efficiency = target_.sparse_gather_efficiency + 
+                                    (kBlockSparseEfficiency - target_.sparse_gather_efficiency) * fill;
+                break;
+            }
+            
+            default: {
+                // csr or a bitmap, whichever indexes the kept weights in fewer bytes
+                int64_t kept = static_cast<int64_t>(std::ceil(numel * sparsity.density));
+                int64_t csr = kept * (cols <= 65536 ? 2 : 4) + (rows + 1) * kIndexBytes;
+                int64_t bitmap = ceilDiv(numel, 8);
+                
+                packed.format = csr <= bitmap ? "csr" : "bitmap";
+                packed.value_bytes = kept * elem;
+                packed.index_bytes = std::min(csr, bitmap);
+                packed.flop_scale = static_cast<double>(kept) / numel;
+                packed.efficiency = target_.sparse_gather_efficiency;
+                break;
+            }
+        }
+        candidates.push_back(packed);
+        
+        // compressed in memory, expanded to dense on chip: saves bandwidth only
+        SparseLowering expanded = packed;
+        expanded.skips_zeros = false;
+        expanded.flop_scale = 1.0;
+        expanded.efficiency = 1.0;
+        expanded.decode_flops = numel;
+        candidates.push_back(expanded);
+    }
     
-    // gen STORE instruction
-    instructions.push_back({
-        InstructionType::STORE,
-        ir::opTypeToString(node->type()),
-        0,
-        output_size,
-        0
+    for (auto& c : candidates) {
+        c.flops_skipped = static_cast<int64_t>(dense_flops * (1.0 - c.flop_scale));
+        c.cycles = estimateCycles(dense_flops * c.flop_scale + c.decode_flops, 
+                                  dense_efficiency * c.efficiency, c.value_bytes + c.index_bytes);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), 
+                     [](const SparseLowering& a, const SparseLowering& b) {
+        return a.cycles < b.cycles;
     });
+    return candidates;
+}
+
+SparseLowering CodeGenerator::selectSparseLowering(const ir::Node* node) const {
+    if (!hasSparseWeight(node)) {
+        return SparseLowering();
+    }
+    if (isConv(node)) {
+        return convChoice(node).sparse;
+    }
+    return sparseCandidates(node, denseMatMulFLOPs(node), 1.0).front();
+}
+
+int64_t CodeGenerator::estimateCycles(double flops, double efficiency, int64_t bytes) const {
+    // compute at the sustained rate plus weight traffic from mem
+    double flops_per_cycle = target_.compute_units * target_.simd_width * 2.0;
+    double bytes_per_cycle = target_.memory_bandwidth_gb_s / target_.clock_freq_ghz;
+    return static_cast<int64_t>(flops / (flops_per_cycle * efficiency) + bytes / bytes_per_cycle);
+}
+
+int64_t CodeGenerator::weightBytes(const ir::Node* node, const ir::Value* weight) const {
+    // winograd / fft filters are stored pre-transformed
+    if (isConv(node) && node->inputs().size() > 1 && node->inputs()[1] == weight) {
+        return convChoice(node).weight_bytes;
+    }
+    // pruned weights are stored compressed, index included
+    if (hasSparseWeight(node) && node->inputs()[1] == weight) {
+        auto sparse = selectSparseLowering(node);
+        return sparse.value_bytes + sparse.index_bytes;
+    }
+    return weight->bytes();
+}
+
+int64_t CodeGenerator::indexBytes(const ir::Node* node, const ir::Value* weight) const {
+    if (!hasSparseWeight(node) || node->inputs()[1] != weight) return 0;
+    return selectSparseLowering(node).index_bytes;
+}
+
+int64_t CodeGenerator::weightReuse(ir::Node* node) {
+    switch (node->type()) {
+        case ir::OpType::CONV2D:
+        case ir::OpType::FUSED_CONV_RELU: {
+            // every batch element and output tile reads the whole filter bank
+            const auto& out = node->outputs()[0]->shape();
+            return out.dims[0] * ceilDiv(out.dims[2], kSpatialTile) * 
+                   ceilDiv(out.dims[3], kSpatialTile);
+        }
+        
+        case ir::OpType::MATMUL:
+        case ir::OpType::FUSED_MATMUL_ADD: {
+            // row tiles of A (across batches) share B; batch-1 FC layers get no reuse
+            const auto& out = node->outputs()[0]->shape();
+            return ceilDiv(out.numel() / out.dims.back(), kRowTile);
+        }
+        
+        default:
+            return 1;
+    }
 }
 
 int64_t CodeGenerator::computeFLOPs(ir::Node* node) {
     switch (node->type()) {
         case ir::OpType::CONV2D:
         case ir::OpType::FUSED_CONV_RELU: {
-            // flops = 2 * C_in * K * K * C_out * H_out * W_out * N
-            auto* output = node->outputs()[0];
-            auto* input = node->inputs()[0];
-            int64_t k = node->getAttr("kernel_size", 3);
-            int64_t c_in = input->shape().dims[1];
-            int64_t c_out = output->shape().dims[1];
-            int64_t h_out = output->shape().dims[2];
-            int64_t w_out = output->shape().dims[3];
-            int64_t n = output->shape().dims[0];
-            return 2 * c_in * k * k * c_out * h_out * w_out * n;
+            // depends on the lowering picked for the target
+            return convChoice(node).flops;
         }
         
         case ir::OpType::MATMUL:
         case ir::OpType::FUSED_MATMUL_ADD: {
-            // flops = 2 * M * N * K
-            auto* a = node->inputs()[0];
-            auto* b = node->inputs()[1];
-            int64_t m = a->shape().dims[0];
-            int64_t k = a->shape().dims[1];
-            int64_t n = b->shape().dims[1];
-            return 2 * m * n * k;
+            int64_t flops = denseMatMulFLOPs(node);
+            if (!hasSparseWeight(node)) return flops;
+            
+            // pruned weights: only the kept ones are multiplied, or the
+            // compressed weights are expanded first
+            auto sparse = selectSparseLowering(node);
+            return static_cast<int64_t>(flops * sparse.flop_scale) + sparse.decode_flops;
+        }
+        
+        case ir::OpType::SOFTMAX: {
+            // max, subtract, exp, sum, divide
+            return 5 * node->outputs()[0]->shape().numel();
+        }
+        
+        case ir::OpType::LAYERNORM: {
+            // mean, variance, normalize, scale and shift
+            return 8 * node->outputs()[0]->shape().numel();
+        }
+        
+        case ir::OpType::GELU: {
+            // tanh approximation
+            return 10 * node->outputs()[0]->shape().numel();
+        }
+        
+        case ir::OpType::FUSED_ATTENTION: {
+            // Q K^T, softmax, P V
+            const auto& q = node->inputs()[0]->shape();
+            const auto& k = node->inputs()[1]->shape();
+            const auto& v = node->inputs()[2]->shape();
+            int64_t s = q.dims[q.rank() - 2];
+            int64_t d = q.dims[q.rank() - 1];
+            int64_t s_kv = k.dims[k.rank() - 2];
+            int64_t d_v = v.dims[v.rank() - 1];
+            int64_t heads = q.numel() / (s * d);
+            return heads * (2 * s * s_kv * d + 5 * s * s_kv + 2 * s * s_kv * d_v);
         }
         
         case ir::OpType::RELU: {
@@ -126,11 +978,96 @@ int64_t CodeGenerator::computeFLOPs(ir::Node* node) {
             return output->shape().numel() * k * k;
         }
         
+        case ir::OpType::GRADIENT:
+            return gradientFLOPs(node);
+        
         default:
             return 0;
     }
 }
 
+int64_t CodeGenerator::gradientFLOPs(ir::Node* node) {
+    // inputs are [dY, saved forward tensors...], outputs follow wrt_i; a Split
+    // gradient instead takes one dY per piece and only copies
+    auto fwd = static_cast<ir::OpType>(node->getAttr("fwd_op"));
+    int64_t dy = node->inputs()[0]->shape().numel();
+    int64_t flops = 0;
+    
+    for (int64_t i = 0; i < node->getAttr("num_grads"); ++i) {
+        int64_t wrt = node->getAttr("wrt_" + std::to_string(i));
+        const auto& grad = node->outputs()[i]->shape();
+        
+        switch (fwd) {
+            case ir::OpType::CONV2D:
+            case ir::OpType::FUSED_CONV_RELU: {
+                // dX and dW are each a convolution as large as the forward one
+                int64_t k = node->getAttr("kernel_size", 3);
+                flops += 2 * dy * grad.dims[1] * k * k;
+                break;
+            }
+            
+            case ir::OpType::MATMUL:
+            case ir::OpType::FUSED_MATMUL_ADD:
+                // dA = dC B^T, dB = A^T dC, dBias = rowsum(dC)
+                if (wrt == 0) flops += 2 * dy * grad.dims[grad.rank() - 1];
+                else if (wrt == 1) flops += 2 * dy * grad.dims[grad.rank() - 2];
+                else flops += dy;
+                break;
+            
+            case ir::OpType::LAYERNORM:
+            case ir::OpType::BATCHNORM:
+                flops += wrt == 0 ? 10 * dy : 2 * dy;
+                break;
+            
+            case ir::OpType::ADD:
+                flops += dy; // reduce over the broadcast dims
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    switch (fwd) {
+        case ir::OpType::FUSED_CONV_RELU:
+        case ir::OpType::RELU:
+            flops += dy; // mask
+            break;
+        
+        case ir::OpType::GELU:
+            flops += 14 * dy;
+            break;
+        
+        case ir::OpType::SOFTMAX:
+            flops += 4 * dy;
+            break;
+        
+        case ir::OpType::MAXPOOL: {
+            int64_t k = node->getAttr("kernel_size", 2);
+            flops += dy * k * k;
+            break;
+        }
+        
+        case ir::OpType::FUSED_ATTENTION: {
+            // recompute S and P per tile, then dV, dP, dS, dQ and dK
+            const auto& q = node->inputs()[1]->shape();
+            const auto& k = node->inputs()[2]->shape();
+            const auto& v = node->inputs()[3]->shape();
+            int64_t s = q.dims[q.rank() - 2];
+            int64_t d = q.dims[q.rank() - 1];
+            int64_t s_kv = k.dims[k.rank() - 2];
+            int64_t d_v = v.dims[v.rank() - 1];
+            int64_t heads = q.numel() / (s * d);
+            flops += heads * (6 * s * s_kv * d + 4 * s * s_kv * d_v + 8 * s * s_kv);
+            break;
+        }
+        
+        default:
+            break;
+    }
+    return flops;
+}
+
 }
 }
 
@@ -0,0 +1,648 @@
+#include "codegen/cpp_emitter.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace dlcompiler {
+namespace codegen {
+
+namespace {
+
+// arena offsets are kept 64-byte aligned
+constexpr int64_t kAlignFloats = 16;
+
+// k-panel of B kept cache resident by the matmul kernel
+constexpr int64_t kPanelFloats = 8192;
+
+// query rows / key columns per attention tile, matches the codegen schedule
+constexpr int64_t kAttentionTile = 64;
+
+// shape-generic kernels; every call site instantiates them with the node's
+// shapes so loop bounds and strides are compile-time constants
+const char* kKernelLibrary = R"KERNELS(#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define DLC_AVX2 1
+#endif
+
+namespace dlc {
+
+// y += a * x
+inline void axpy(int n, float a, const float* __restrict x, float* __restrict y) {
+    int j = 0;
+#ifdef DLC_AVX2
+    const __m256 va = _mm256_set1_ps(a);
+    for (; j + 8 <= n; j += 8) {
+        _mm256_storeu_ps(y + j, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+    }
+#endif
+    for (; j < n; ++j) y[j] += a * x[j];
+}
+
+// may run in place
+template <long long N>
+inline void relu(const float* x, float* y) {
+#ifdef DLC_AVX2
+    constexpr long long kVec = N / 8 * 8;
+    const __m256 zero = _mm256_setzero_ps();
+    for (long long i = 0; i < kVec; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_max_ps(_mm256_loadu_ps(x + i), zero));
+    }
+#else
+    constexpr long long kVec = 0;
+#endif
+    for (long long i = kVec; i < N; ++i) y[i] = std::max(x[i], 0.f);
+}
+
+// b is broadcast over a when BN < N
+template <long long N, long long BN>
+inline void add(const float* a, const float* b, float* y) {
+    static_assert(N % BN == 0, "broadcast operand must tile the output");
+    for (long long base = 0; base < N; base += BN) {
+        long long i = 0;
+#ifdef DLC_AVX2
+        for (; i + 8 <= BN; i += 8) {
+            _mm256_storeu_ps(y + base + i, _mm256_add_ps(_mm256_loadu_ps(a + base + i),
+                                                         _mm256_loadu_ps(b + i)));
+        }
+#endif
+        for (; i < BN; ++i) y[base + i] = a[base + i] + b[i];
+    }
+}
+
+// C[M,N] = A[M,K] x B[K,N] (+ bias) (relu); bias has 0, 1 or M rows
+template <int M, int K, int N, int TK, int BIAS_ROWS, bool RELU>
+inline void matmul(const float* __restrict A, const float* __restrict B,
+                   const float* __restrict bias, float* __restrict C) {
+    for (int i = 0; i < M; ++i) {
+        float* c = C + static_cast<std::ptrdiff_t>(i) * N;
+        if (BIAS_ROWS == 0) {
+            std::fill(c, c + N, 0.f);
+        } else {
+            const float* b = bias + (BIAS_ROWS == 1 ? 0 : static_cast<std::ptrdiff_t>(i) * N);
+            std::memcpy(c, b, sizeof(float) * N);
+        }
+    }
+    // k-blocked so a TK x N panel of B stays in cache across rows
+    for (int kk = 0; kk < K; kk += TK) {
+        const int k_end = kk + TK < K ? kk + TK : K;
+        for (int i = 0; i < M; ++i) {
+            const float* a = A + static_cast<std::ptrdiff_t>(i) * K;
+            float* c = C + static_cast<std::ptrdiff_t>(i) * N;
+            for (int k = kk; k < k_end; ++k) {
+                axpy(N, a[k], B + static_cast<std::ptrdiff_t>(k) * N, c);
+            }
+        }
+    }
+    if (RELU) relu<static_cast<long long>(M) * N>(C, C);
+}
+
+// direct NCHW convolution, weights [CO, CI, KS, KS]
+template <int NB, int CI, int H, int W, int CO, int KS, int S, int P, int HO, int WO, bool RELU>
+inline void conv2d(const float* __restrict in, const float* __restrict w, float* __restrict out) {
+    for (int n = 0; n < NB; ++n) {
+        for (int co = 0; co < CO; ++co) {
+            float* o = out + (static_cast<std::ptrdiff_t>(n) * CO + co) * HO * WO;
+            std::fill(o, o + HO * WO, 0.f);
+            for (int ci = 0; ci < CI; ++ci) {
+                const float* x = in + (static_cast<std::ptrdiff_t>(n) * CI + ci) * H * W;
+                const float* f = w + (static_cast<std::ptrdiff_t>(co) * CI + ci) * KS * KS;
+                for (int kh = 0; kh < KS; ++kh) {
+                    for (int kw = 0; kw < KS; ++kw) {
+                        if (W - 1 + P - kw < 0) continue;
+                        // output columns whose input column is in bounds
+                        const int ow_lo = std::max(0, (P - kw + S - 1) / S);
+                        const int ow_hi = std::min(WO, (W - 1 + P - kw) / S + 1);
+                        const float wv = f[kh * KS + kw];
+                        for (int oh = 0; oh < HO; ++oh) {
+                            const int ih = oh * S - P + kh;
+                            if (ih < 0 || ih >= H) continue;
+                            const float* xr = x + static_cast<std::ptrdiff_t>(ih) * W;
+                            float* orow = o + static_cast<std::ptrdiff_t>(oh) * WO;
+                            if (S == 1) {
+                                axpy(ow_hi - ow_lo, wv, xr + ow_lo - P + kw, orow + ow_lo);
+                            } else {
+                                for (int ow = ow_lo; ow < ow_hi; ++ow) {
+                                    orow[ow] += wv * xr[ow * S - P + kw];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            if (RELU) relu<static_cast<long long>(HO) * WO>(o, o);
+        }
+    }
+}
+
+// out[o] = in[o][OFFSET : OFFSET + ROW] for each of OUTER rows of IN_ROW floats
+template <long long OUTER, long long IN_ROW, long long OFFSET, long long ROW>
+inline void slice(const float* __restrict in, float* __restrict out) {
+    for (long long o = 0; o < OUTER; ++o) {
+        std::memcpy(out + o * ROW, in + o * IN_ROW + OFFSET, sizeof(float) * ROW);
+    }
+}
+
+// over the last axis
+template <int ROWS, int COLS>
+inline void softmax(const float* __restrict x, float* __restrict y) {
+    for (int r = 0; r < ROWS; ++r) {
+        const float* xr = x + static_cast<std::ptrdiff_t>(r) * COLS;
+        float* yr = y + static_cast<std::ptrdiff_t>(r) * COLS;
+        float m = xr[0];
+        for (int c = 1; c < COLS; ++c) m = std::max(m, xr[c]);
+        float sum = 0.f;
+        for (int c = 0; c < COLS; ++c) {
+            yr[c] = std::exp(xr[c] - m);
+            sum += yr[c];
+        }
+        const float inv = 1.f / sum;
+        for (int c = 0; c < COLS; ++c) yr[c] *= inv;
+    }
+}
+
+template <int ROWS, int COLS>
+inline void layernorm(const float* __restrict x, const float* __restrict gamma,
+                      const float* __restrict beta, float* __restrict y) {
+    for (int r = 0; r < ROWS; ++r) {
+        const float* xr = x + static_cast<std::ptrdiff_t>(r) * COLS;
+        float* yr = y + static_cast<std::ptrdiff_t>(r) * COLS;
+        float mean = 0.f;
+        for (int c = 0; c < COLS; ++c) mean += xr[c];
+        mean /= COLS;
+        float var = 0.f;
+        for (int c = 0; c < COLS; ++c) var += (xr[c] - mean) * (xr[c] - mean);
+        const float inv = 1.f / std::sqrt(var / COLS + 1e-5f);
+        for (int c = 0; c < COLS; ++c) yr[c] = (xr[c] - mean) * inv * gamma[c] + beta[c];
+    }
+}
+
+// tanh approximation
+template <long long N>
+inline void gelu(const float* x, float* y) {
+    for (long long i = 0; i < N; ++i) {
+        const float v = x[i];
+        y[i] = 0.5f * v * (1.f + std::tanh(0.7978845608f * (v + 0.044715f * v * v * v)));
+    }
+}
+
+// out dim i is in dim perm[i]
+template <int RANK>
+inline void transpose(const float* __restrict in, float* __restrict out,
+                      const long long (&dims)[RANK], const int (&perm)[RANK]) {
+    long long in_stride[RANK];
+    long long out_dims[RANK];
+    long long n = 1;
+    for (int i = RANK - 1; i >= 0; --i) {
+        in_stride[i] = n;
+        n *= dims[i];
+    }
+    for (int i = 0; i < RANK; ++i) out_dims[i] = dims[perm[i]];
+    
+    long long idx[RANK] = {};
+    for (long long o = 0; o < n; ++o) {
+        long long src = 0;
+        for (int i = 0; i < RANK; ++i) src += idx[i] * in_stride[perm[i]];
+        out[o] = in[src];
+        for (int i = RANK - 1; i >= 0; --i) {
+            if (++idx[i] < out_dims[i]) break;
+            idx[i] = 0;
+        }
+    }
+}
+
+// softmax(Q K^T) V per head, one BR x BC score tile at a time with an
+// online softmax, so the S x SKV matrix is never materialized
+template <int BH, int S, int SKV, int D, int DV, int BR, int BC>
+inline void attention(const float* __restrict q, const float* __restrict k,
+                      const float* __restrict v, float* __restrict o) {
+    float scores[BR * BC];
+    float acc[BR * DV];
+    float row_max[BR];
+    float row_sum[BR];
+    for (int h = 0; h < BH; ++h) {
+        const float* qh = q + static_cast<std::ptrdiff_t>(h) * S * D;
+        const float* kh = k + static_cast<std::ptrdiff_t>(h) * SKV * D;
+        const float* vh = v + static_cast<std::ptrdiff_t>(h) * SKV * DV;
+        float* oh = o + static_cast<std::ptrdiff_t>(h) * S * DV;
+        for (int i0 = 0; i0 < S; i0 += BR) {
+            const int rows = std::min(BR, S - i0);
+            std::fill(acc, acc + rows * DV, 0.f);
+            std::fill(row_max, row_max + rows, -3.402823466e38f);
+            std::fill(row_sum, row_sum + rows, 0.f);
+            for (int j0 = 0; j0 < SKV; j0 += BC) {
+                const int cols = std::min(BC, SKV - j0);
+                for (int r = 0; r < rows; ++r) {
+                    const float* qr = qh + static_cast<std::ptrdiff_t>(i0 + r) * D;
+                    float* sr = scores + r * BC;
+                    float m = row_max[r];
+                    for (int c = 0; c < cols; ++c) {
+                        const float* kc = kh + static_cast<std::ptrdiff_t>(j0 + c) * D;
+                        float dot = 0.f;
+                        for (int d = 0; d < D; ++d) dot += qr[d] * kc[d];
+                        sr[c] = dot;
+                        m = std::max(m, dot);
+                    }
+                    // rescale what was accumulated under the old max
+                    const float correction = std::exp(row_max[r] - m);
+                    float* ar = acc + r * DV;
+                    for (int d = 0; d < DV; ++d) ar[d] *= correction;
+                    row_sum[r] *= correction;
+                    row_max[r] = m;
+                    for (int c = 0; c < cols; ++c) {
+                        const float p = std::exp(sr[c] - m);
+                        row_sum[r] += p;
+                        axpy(DV, p, vh + static_cast<std::ptrdiff_t>(j0 + c) * DV, ar);
+                    }
+                }
+            }
+            for (int r = 0; r < rows; ++r) {
+                const float inv = 1.f / row_sum[r];
+                float* orow = oh + static_cast<std::ptrdiff_t>(i0 + r) * DV;
+                for (int d = 0; d < DV; ++d) orow[d] = acc[r * DV + d] * inv;
+            }
+        }
+    }
+}
+
+template <int NB, int C, int H, int W, int KS, int S, int HO, int WO>
+inline void maxpool(const float* __restrict in, float* __restrict out) {
+    for (int nc = 0; nc < NB * C; ++nc) {
+        const float* x = in + static_cast<std::ptrdiff_t>(nc) * H * W;
+        float* o = out + static_cast<std::ptrdiff_t>(nc) * HO * WO;
+        for (int oh = 0; oh < HO; ++oh) {
+            for (int ow = 0; ow < WO; ++ow) {
+                float m = x[(oh * S) * W + ow * S];
+                for (int kh = 0; kh < KS; ++kh) {
+                    for (int kw = 0; kw < KS; ++kw) {
+                        m = std::max(m, x[(oh * S + kh) * W + ow * S + kw]);
+                    }
+                }
+                o[oh * WO + ow] = m;
+            }
+        }
+    }
+}
+
+}
+)KERNELS";
+
+std::string dimList(const ir::Shape& shape) {
+    std::stringstream ss;
+    for (size_t i = 0; i < shape.rank(); ++i) {
+        if (i) ss << ", ";
+        ss << shape.dims[i];
+    }
+    return ss.str();
+}
+
+}
+
+std::string CppEmitter::emit(ir::Graph* graph) {
+    if (!graph->isStatic()) {
+        throw std::runtime_error("cpp emitter needs static shapes, specialize the graph first");
+    }
+    
+    auto nodes = graph->getNodesInTopoOrder();
+    planBuffers(nodes);
+    
+    std::vector<const ir::Value*> weights;
+    std::vector<const ir::Node*> outputs;
+    for (auto* node : nodes) {
+        for (auto* output : node->outputs()) {
+            if (output->elemBytes() != sizeof(float)) {
+                throw std::runtime_error("cpp emitter only supports fp32 tensors");
+            }
+            if (output->isConstant()) weights.push_back(output);
+        }
+        if (node->type() == ir::OpType::OUTPUT) outputs.push_back(node);
+    }
+    
+    std::stringstream ss;
+    ss << "// generated by dl_compiler: " << nodes.size() << " nodes, "
+       << input_index_.size() << " inputs, " << outputs.size() << " outputs\n";
+    ss << kKernelLibrary << "\n";
+    ss << "namespace dlc_model {\n\n";
+    
+    // weight storage, filled by the caller before run()
+    for (auto* w : weights) {
+        ss << "alignas(64) static float w_v" << w->id() << "[" << w->shape().numel() 
+           << "]; // " << w->shape().toString() << "\n";
+    }
+    ss << "\nfloat* weight(int value_id) {\n    switch (value_id) {\n";
+    for (auto* w : weights) {
+        ss << "        case " << w->id() << ": return w_v" << w->id() << ";\n";
+    }
+    ss << "        default: return nullptr;\n    }\n}\n\n";
+    ss << "std::size_t weight_floats(int value_id) {\n    switch (value_id) {\n";
+    for (auto* w : weights) {
+        ss << "        case " << w->id() << ": return " << w->shape().numel() << ";\n";
+    }
+    ss << "        default: return 0;\n    }\n}\n\n";
+    
+    ss << "constexpr int kNumInputs = " << input_index_.size() << ";\n";
+    ss << "constexpr int kNumOutputs = " << outputs.size() << ";\n";
+    ss << "constexpr long long kArenaFloats = " << plan_.arena_floats << ";\n\n";
+    ss << "alignas(64) static float arena[" << std::max<int64_t>(plan_.arena_floats, 1) << "];\n\n";
+    
+    ss << "// inputs and outputs in graph order\n";
+    ss << "void run(const float* const* inputs, float* const* outputs) {\n";
+    std::stringstream body;
+    size_t output_slot = 0;
+    for (auto* node : nodes) {
+        if (node->type() == ir::OpType::INPUT || node->type() == ir::OpType::CONSTANT) continue;
+        if (node->type() == ir::OpType::RESHAPE) continue; // view of its input
+        
+        body << "    // Node" << node->id() << " " << ir::opTypeToString(node->type());
+        if (!node->inputs().empty()) body << " " << node->inputs()[0]->shape().toString();
+        body << " -> " << node->outputs()[0]->shape().toString() << "\n";
+        
+        if (node->type() == ir::OpType::OUTPUT) {
+            auto* value = node->inputs()[0];
+            body << "    std::memcpy(outputs[" << output_slot++ << "], " << valueRef(value) 
+                 << ", sizeof(float) * " << value->shape().numel() << ");\n";
+            continue;
+        }
+        body << "    " << emitKernelCall(node) << "\n";
+    }
+    // graphs without inputs or outputs would leave the parameters unused
+    std::string code = body.str();
+    if (code.find("inputs[") == std::string::npos) ss << "    (void)inputs;\n";
+    if (code.find("outputs[") == std::string::npos) ss << "    (void)outputs;\n";
+    ss << code;
+    ss << "}\n\n}\n";
+    
+    return ss.str();
+}
+
+void CppEmitter::planBuffers(const std::vector<ir::Node*>& nodes) {
+    plan_ = {};
+    input_index_.clear();
+    
+    // lifetime of each activation in program positions
+    struct Interval {
+        const ir::Value* value;
+        size_t def;
+        size_t last_use;
+        int64_t size;
+    };
+    std::unordered_map<int, size_t> def_pos;
+    std::vector<Interval> intervals;
+    
+    for (size_t pos = 0; pos < nodes.size(); ++pos) {
+        auto* node = nodes[pos];
+        for (auto* input : node->inputs()) {
+            auto it = def_pos.find(input->storage(false)->id());
+            if (it != def_pos.end()) intervals[it->second].last_use = pos;
+        }
+        
+        // reshape only renames the buffer, its readers keep the source alive
+        if (node->type() == ir::OpType::RESHAPE) continue;
+        
+        if (node->type() == ir::OpType::INPUT) {
+            int slot = static_cast<int>(input_index_.size());
+            input_index_[node->outputs()[0]->id()] = slot;
+            continue;
+        }
+        if (node->type() == ir::OpType::OUTPUT || node->type() == ir::OpType::CONSTANT) continue;
+        
+        for (auto* output : node->outputs()) {
+            int64_t size = (output->shape().numel() + kAlignFloats - 1) / kAlignFloats * kAlignFloats;
+            def_pos[output->id()] = intervals.size();
+            intervals.push_back({output, pos, pos, size});
+        }
+    }
+    
+    // largest first, each at the lowest offset free over its lifetime
+    std::vector<size_t> order(intervals.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return intervals[a].size > intervals[b].size;
+    });
+    
+    std::vector<size_t> placed;
+    for (size_t idx : order) {
+        const auto& cur = intervals[idx];
+        
+        std::vector<std::pair<int64_t, int64_t>> busy; // [begin, end) in floats
+        for (size_t other : placed) {
+            const auto& o = intervals[other];
+            if (o.def <= cur.last_use && cur.def <= o.last_use) {
+                int64_t begin = plan_.offsets[o.value->id()];
+                busy.push_back({begin, begin + o.size});
+            }
+        }
+        std::sort(busy.begin(), busy.end());
+        
+        int64_t offset = 0;
+        for (const auto& b : busy) {
+            if (offset + cur.size <= b.first) break;
+            offset = std::max(offset, b.second);
+        }
+        
+        plan_.offsets[cur.value->id()] = offset;
+        plan_.arena_floats = std::max(plan_.arena_floats, offset + cur.size);
+        placed.push_back(idx);
+    }
+}
+
+std::string CppEmitter::valueRef(const ir::Value* value) const {
+    value = value->storage(false); // split pieces are copied out, not views
+    if (value->isConstant()) {
+        return "w_v" + std::to_string(value->id());
+    }
+    auto in = input_index_.find(value->id());
+    if (in != input_index_.end()) {
+        return "inputs[" + std::to_string(in->second) + "]";
+    }
+    return "arena + " + std::to_string(plan_.offsets.at(value->id()));
+}
+
+std::string CppEmitter::emitKernelCall(const ir::Node* node) const {
+    std::stringstream ss;
+    const auto& out = node->outputs()[0]->shape();
+    std::string dst = valueRef(node->outputs()[0]);
+    
+    switch (node->type()) {
+        case ir::OpType::CONV2D:
+        case ir::OpType::FUSED_CONV_RELU: {
+            const auto& in = node->inputs()[0]->shape();
+            bool relu = node->type() == ir::OpType::FUSED_CONV_RELU;
+            if (node->getAttr("kernel_size", 3) == 1 && node->getAttr("stride", 1) == 1 &&
+                node->getAttr("padding", 0) == 0) {
+                // pointwise: W[C_out, C_in] x X[C_in, H*W] per image
+                int64_t c_in = in.dims[1];
+                int64_t c_out = out.dims[1];
+                int64_t hw = out.dims[2] * out.dims[3];
+                int64_t tk = std::max<int64_t>(1, std::min(c_in, kPanelFloats / std::max<int64_t>(hw, 1)));
+                ss << "for (int b = 0; b < " << in.dims[0] << "; ++b) dlc::matmul<" << c_out << ", "
+                   << c_in << ", " << hw << ", " << tk << ", 0, " << (relu ? "true" : "false") << ">("
+                   << valueRef(node->inputs()[1]) << ", " << valueRef(node->inputs()[0]) << " + b * "
+                   << c_in * hw << ", nullptr, " << dst << " + b * " << c_out * hw << ");";
+                break;
+            }
+            ss << "dlc::conv2d<" << dimList(in) << ", " << out.dims[1] << ", "
+               << node->getAttr("kernel_size", 3) << ", " << node->getAttr("stride", 1) << ", "
+               << node->getAttr("padding", 0) << ", " << out.dims[2] << ", " << out.dims[3] << ", "
+               << (relu ? "true" : "false") << ">("
+               << valueRef(node->inputs()[0]) << ", " << valueRef(node->inputs()[1]) << ", "
+               << dst << ");";
+            break;
+        }
+        
+        case ir::OpType::MATMUL:
+        case ir::OpType::FUSED_MATMUL_ADD: {
+            const auto& a = node->inputs()[0]->shape();
+            const auto& b = node->inputs()[1]->shape();
+            size_t rank = out.rank();
+            int64_t m = a.dims[a.rank() - 2];
+            int64_t k = a.dims[a.rank() - 1];
+            int64_t n = out.dims[rank - 1];
+            int64_t batch = out.numel() / (m * n);
+            int64_t tk = std::max<int64_t>(1, std::min(k, kPanelFloats / std::max<int64_t>(n, 1)));
+            
+            // each operand is either per-batch or shared by every batch
+            int64_t a_batch = a.numel() / (m * k);
+            int64_t b_batch = b.numel() / (k * n);
+            if ((a_batch != 1 && a_batch != batch) || (b_batch != 1 && b_batch != batch)) {
+                throw std::runtime_error("cpp emitter: unsupported batch broadcast in MatMul");
+            }
+            
+            int64_t bias_rows = 0;
+            int64_t bias_batch = 1;
+            std::string bias = "nullptr";
+            if (node->type() == ir::OpType::FUSED_MATMUL_ADD && node->inputs().size() > 2) {
+                int64_t bias_numel = node->inputs()[2]->shape().numel();
+                bias_rows = bias_numel == n ? 1 : m;
+                bias_batch = bias_numel / (bias_rows * n);
+                if (bias_numel % n != 0 || (bias_rows == m && bias_numel % (m * n) != 0) ||
+                    (bias_batch != 1 && bias_batch != batch)) {
+                    throw std::runtime_error("cpp emitter: unsupported bias shape in FusedMatMulAdd");
+                }
+                bias = valueRef(node->inputs()[2]);
+            }
+            
+            std::stringstream call;
+            call << "dlc::matmul<" << m << ", " << k << ", " << n << ", " << tk << ", "
+                 << bias_rows << ", false>";
+            if (batch == 1) {
+                ss << call.str() << "(" << valueRef(node->inputs()[0]) << ", "
+                   << valueRef(node->inputs()[1]) << ", " << bias << ", " << dst << ");";
+                break;
+            }
+            
+            auto offset = [](int64_t per_batch, int64_t stride) {
+                return per_batch == 1 ? std::string() : " + b * " + std::to_string(stride);
+            };
+            ss << "for (int b = 0; b < " << batch << "; ++b) " << call.str() << "("
+               << valueRef(node->inputs()[0]) << offset(a_batch, m * k) << ", "
+               << valueRef(node->inputs()[1]) << offset(b_batch, k * n) << ", "
+               << bias << (bias_rows ? offset(bias_batch, m * n) : "") << ", "
+               << dst << " + b * " << m * n << ");";
+            break;
+        }
+        
+        case ir::OpType::SOFTMAX:
+        case ir::OpType::LAYERNORM: {
+            int64_t cols = out.dims[out.rank() - 1];
+            ss << "dlc::" << (node->type() == ir::OpType::SOFTMAX ? "softmax" : "layernorm")
+               << "<" << out.numel() / cols << ", " << cols << ">(" << valueRef(node->inputs()[0]);
+            if (node->type() == ir::OpType::LAYERNORM) {
+                ss << ", " << valueRef(node->inputs()[1]) << ", " << valueRef(node->inputs()[2]);
+            }
+            ss << ", " << dst << ");";
+            break;
+        }
+        
+        case ir::OpType::SPLIT: {
+            // one contiguous copy per output
+            const auto& in = node->inputs()[0]->shape();
+            int64_t axis = node->getAttr("axis");
+            int64_t outer = 1;
+            int64_t inner = 1;
+            for (int64_t d = 0; d < axis; ++d) outer *= in.dims[d];
+            for (size_t d = axis + 1; d < in.rank(); ++d) inner *= in.dims[d];
+            
+            int64_t offset = 0;
+            for (size_t i = 0; i < node->outputs().size(); ++i) {
+                int64_t size = node->getAttr("size_" + std::to_string(i));
+                if (i) ss << "\n    ";
+                ss << "dlc::slice<" << outer << ", " << in.dims[axis] * inner << ", " 
+                   << offset * inner << ", " << size * inner << ">(" 
+                   << valueRef(node->inputs()[0]) << ", " << valueRef(node->outputs()[i]) << ");";
+                offset += size;
+            }
+            break;
+        }
+        
+        case ir::OpType::GELU:
+            ss << "dlc::gelu<" << out.numel() << ">(" << valueRef(node->inputs()[0]) 
+               << ", " << dst << ");";
+            break;
+        
+        case ir::OpType::TRANSPOSE: {
+            const auto& in = node->inputs()[0]->shape();
+            ss << "dlc::transpose<" << in.rank() << ">(" << valueRef(node->inputs()[0]) << ", "
+               << dst << ", {" << dimList(in) << "}, {";
+            for (size_t i = 0; i < in.rank(); ++i) {
+                if (i) ss << ", ";
+                ss << node->getAttr("perm_" + std::to_string(i));
+            }
+            ss << "});";
+            break;
+        }
+        
+        case ir::OpType::FUSED_ATTENTION: {
+            const auto& q = node->inputs()[0]->shape();
+            const auto& k = node->inputs()[1]->shape();
+            const auto& v = node->inputs()[2]->shape();
+            int64_t s = q.dims[q.rank() - 2];
+            int64_t d = q.dims[q.rank() - 1];
+            int64_t s_kv = k.dims[k.rank() - 2];
+            int64_t d_v = v.dims[v.rank() - 1];
+            ss << "dlc::attention<" << q.numel() / (s * d) << ", " << s << ", " << s_kv << ", "
+               << d << ", " << d_v << ", " << std::min(kAttentionTile, s) << ", "
+               << std::min(kAttentionTile, s_kv) << ">(" << valueRef(node->inputs()[0]) << ", "
+               << valueRef(node->inputs()[1]) << ", " << valueRef(node->inputs()[2]) << ", "
+               << dst << ");";
+            break;
+        }
+        
+        case ir::OpType::RELU:
+            ss << "dlc::relu<" << out.numel() << ">(" << valueRef(node->inputs()[0]) 
+               << ", " << dst << ");";
+            break;
+        
+        case ir::OpType::ADD: {
+            auto* a = node->inputs()[0];
+            auto* b = node->inputs()[1];
+            if (a->shape().numel() < b->shape().numel()) std::swap(a, b);
+            if (a->shape().numel() % b->shape().numel() != 0) {
+                throw std::runtime_error("cpp emitter: unsupported broadcast in Add");
+            }
+            ss << "dlc::add<" << a->shape().numel() << ", " << b->shape().numel() << ">("
+               << valueRef(a) << ", " << valueRef(b) << ", " << dst << ");";
+            break;
+        }
+        
+        case ir::OpType::MAXPOOL: {
+            const auto& in = node->inputs()[0]->shape();
+            ss << "dlc::maxpool<" << dimList(in) << ", " << node->getAttr("kernel_size", 2) << ", "
+               << node->getAttr("stride", 2) << ", " << out.dims[2] << ", " << out.dims[3] << ">("
+               << valueRef(node->inputs()[0]) << ", " << dst << ");";
+            break;
+        }
+        
+        default:
+            throw std::runtime_error("cpp emitter: unsupported op " + 
+                                     ir::opTypeToString(node->type()));
+    }
+    
+    return ss.str();
+}
+
+}
+}
@@ -0,0 +1,15 @@
+#include "compiler/cost_model.h"
+#include "codegen/codegen.h"
+#include "simulator/simulator.h"
+
+namespace dlcompiler {
+namespace compiler {
+
+int64_t SimulatedCost::cycles(ir::Graph* graph) const {
+    codegen::CodeGenerator codegen(config_);
+    simulator::Simulator sim(config_);
+    return sim.execute(codegen.generate(graph)).cycles;
+}
+
+}
+}
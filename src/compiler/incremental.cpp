@@ -0,0 +1,353 @@
+#include "compiler/incremental.h"
+#include <algorithm>
+#include <set>
+
+namespace dlcompiler {
+namespace compiler {
+
+namespace {
+
+void erasePeak(std::multiset<int64_t>& peaks, int64_t peak) {
+    auto it = peaks.find(peak);
+    if (it != peaks.end()) peaks.erase(it);
+}
+
+}
+
+IncrementalCompiler::IncrementalCompiler(ir::Graph* graph, optimizer::Optimizer& opt,
+                                         const simulator::ChipConfig& config)
+    : graph_(graph), opt_(opt), codegen_(config), sim_(config) {}
+
+const simulator::ExecutionStats& IncrementalCompiler::compile() {
+    opt_.run(graph_);
+    rebuildIndex();
+    codegen_.invalidateAll();
+    
+    segments_.assign(order_.size(), {});
+    node_stats_.assign(order_.size(), {});
+    state_after_.assign(order_.size(), {});
+    for (size_t pos = 0; pos < order_.size(); ++pos) {
+        emit(pos);
+    }
+    
+    sim_.reset();
+    raw_ = {};
+    // one entry per node, starting at 0
+    sram_peaks_ = std::multiset<int64_t>();
+    activation_peaks_ = std::multiset<int64_t>();
+    working_set_peaks_ = std::multiset<int64_t>();
+    for (size_t pos = 0; pos < order_.size(); ++pos) {
+        sram_peaks_.insert(0);
+        activation_peaks_.insert(0);
+        working_set_peaks_.insert(0);
+    }
+    simulateFrom(0, order_.size());
+    finalizeTotal();
+    
+    dirty_.clear();
+    last_update_ = {order_.size(), order_.size(), order_.size()};
+    return total_;
+}
+
+void IncrementalCompiler::setAttr(ir::Node* node, const std::string& key, int64_t value) {
+    node->setAttr(key, value);
+    dirty_.insert(node->id());
+}
+
+const simulator::ExecutionStats& IncrementalCompiler::update() {
+    last_update_ = {};
+    if (dirty_.empty()) {
+        return total_;
+    }
+    if (static_cast<size_t>(graph_->numNodes()) != order_.size() || !opt_.localizes()) {
+        return compile();
+    }
+    
+    // re-infer shapes forward from the edits; stop where shapes don't change
+    std::set<size_t> worklist;
+    for (int id : dirty_) {
+        worklist.insert(position_.at(id));
+    }
+    std::set<size_t> affected;
+    while (!worklist.empty()) {
+        size_t pos = *worklist.begin();
+        worklist.erase(worklist.begin());
+        affected.insert(pos);
+        
+        auto* node = order_[pos];
+        if (!graph_->inferShape(node)) continue;
+        for (auto* output : node->outputs()) {
+            for (auto* user : region_.uses[output]) {
+                worklist.insert(position_.at(user->id()));
+            }
+        }
+    }
+    
+    // fusion looks one hop across the edit
+    std::set<size_t> region = affected;
+    for (size_t pos : affected) {
+        for (auto* input : order_[pos]->inputs()) {
+            if (input->producer()) region.insert(position_.at(input->producer()->id()));
+        }
+        for (auto* output : order_[pos]->outputs()) {
+            for (auto* user : region_.uses[output]) {
+                region.insert(position_.at(user->id()));
+            }
+        }
+    }
+    
+    // tracked by id from here on: the optimizer may erase region nodes
+    std::vector<ir::Node*> region_nodes;
+    std::unordered_set<int> redo;
+    for (size_t pos : region) {
+        region_nodes.push_back(order_[pos]);
+        redo.insert(order_[pos]->id());
+    }
+    region_.clearEdits();
+    opt_.runOnRegion(graph_, region_nodes, region_);
+    
+    if (!region_.erased.empty() || !region_.added.empty()) {
+        if (!splice(redo)) return compile();
+    }
+    if (!region_.touched.empty() || !region_.erased.empty()) {
+        refreshLiveness(redo);
+    }
+    
+    // the previous compute node prefetches this one's weights
+    std::set<size_t> emitted;
+    for (int id : redo) {
+        codegen_.invalidate(id);
+        auto it = position_.find(id);
+        if (it != position_.end()) emitted.insert(it->second);
+    }
+    for (size_t pos : std::set<size_t>(emitted)) {
+        if (auto* prev = prevCompute(pos)) emitted.insert(position_.at(prev->id()));
+    }
+    for (size_t pos : emitted) {
+        emit(pos);
+    }
+    
+    size_t start = *emitted.begin();
+    if (start == 0) {
+        sim_.reset();
+    } else {
+        sim_.restore(state_after_[start - 1]);
+    }
+    simulateFrom(start, *emitted.rbegin());
+    finalizeTotal();
+    
+    dirty_.clear();
+    last_update_.reoptimized = region_nodes.size();
+    last_update_.reemitted = emitted.size();
+    return total_;
+}
+
+std::vector<codegen::Instruction> IncrementalCompiler::instructions() const {
+    std::vector<codegen::Instruction> result;
+    for (const auto& segment : segments_) {
+        result.insert(result.end(), segment.begin(), segment.end());
+    }
+    return result;
+}
+
+void IncrementalCompiler::rebuildIndex() {
+    order_ = graph_->getNodesInTopoOrder();
+    position_.clear();
+    region_ = {};
+    for (size_t pos = 0; pos < order_.size(); ++pos) {
+        position_[order_[pos]->id()] = pos;
+        for (auto* input : order_[pos]->inputs()) {
+            region_.uses[input].push_back(order_[pos]);
+        }
+    }
+    liveness_ = codegen::CodeGenerator::analyzeLiveness(order_);
+}
+
+bool IncrementalCompiler::splice(std::unordered_set<int>& redo) {
+    // drop erased nodes with their stats; the compute nodes around each gap
+    // now prefetch for / follow a different neighbour
+    std::vector<bool> gone(order_.size(), false);
+    for (int id : region_.erased) {
+        size_t pos = position_.at(id);
+        gone[pos] = true;
+        raw_ -= node_stats_[pos];
+        erasePeak(sram_peaks_, node_stats_[pos].peak_sram_bytes);
+        erasePeak(activation_peaks_, node_stats_[pos].peak_activation_bytes);
+        erasePeak(working_set_peaks_, node_stats_[pos].peak_working_set_bytes);
+        position_.erase(id);
+    }
+    
+    size_t first = order_.size();
+    size_t kept = 0;
+    std::vector<size_t> gaps; // index of the first node after each gap
+    for (size_t pos = 0; pos < order_.size(); ++pos) {
+        if (gone[pos]) {
+            first = std::min(first, pos);
+            if (gaps.empty() || gaps.back() != kept) gaps.push_back(kept);
+            continue;
+        }
+        if (kept != pos) {
+            order_[kept] = order_[pos];
+            segments_[kept] = std::move(segments_[pos]);
+            node_stats_[kept] = node_stats_[pos];
+            state_after_[kept] = std::move(state_after_[pos]);
+        }
+        kept++;
+    }
+    order_.resize(kept);
+    segments_.resize(kept);
+    node_stats_.resize(kept);
+    state_after_.resize(kept);
+    
+    // an added node goes right after the last of its producers, which must
+    // still come before all of its readers
+    std::vector<ir::Node*> added = region_.added;
+    std::sort(added.begin(), added.end(),
+              [](const ir::Node* a, const ir::Node* b) { return a->id() < b->id(); });
+    for (auto* node : added) {
+        size_t pos = 0;
+        for (auto* input : node->inputs()) {
+            if (!input->producer()) continue;
+            auto it = position_.find(input->producer()->id());
+            if (it == position_.end()) return false;
+            pos = std::max(pos, it->second + 1);
+        }
+        for (auto* output : node->outputs()) {
+            for (auto* user : region_.uses[output]) {
+                auto it = position_.find(user->id());
+                if (it != position_.end() && it->second < pos) return false;
+            }
+        }
+        
+        order_.insert(order_.begin() + pos, node);
+        segments_.insert(segments_.begin() + pos, std::vector<codegen::Instruction>());
+        node_stats_.insert(node_stats_.begin() + pos, simulator::ExecutionStats());
+        state_after_.insert(state_after_.begin() + pos, simulator::Simulator::State());
+        sram_peaks_.insert(0);
+        activation_peaks_.insert(0);
+        working_set_peaks_.insert(0);
+        for (auto& gap : gaps) {
+            if (gap > pos) gap++;
+        }
+        for (size_t i = pos; i < order_.size(); ++i) {
+            position_[order_[i]->id()] = i;
+        }
+        first = std::min(first, pos);
+        redo.insert(node->id());
+    }
+    for (size_t i = first; i < order_.size(); ++i) {
+        position_[order_[i]->id()] = i;
+    }
+    
+    // rewired nodes must still read only what comes before them
+    for (int id : region_.touched) {
+        auto it = position_.find(id);
+        if (it == position_.end()) continue;
+        for (auto* input : order_[it->second]->inputs()) {
+            auto* producer = input->producer();
+            if (producer && !producer->inputs().empty() && 
+                position_.at(producer->id()) > it->second) {
+                return false;
+            }
+        }
+    }
+    
+    for (size_t gap : gaps) {
+        if (gap < order_.size()) {
+            auto* next = codegen::CodeGenerator::isComputeNode(order_[gap]) ? order_[gap] 
+                                                                             : nextCompute(gap);
+            if (next) redo.insert(next->id());
+        }
+        if (auto* prev = prevCompute(gap)) redo.insert(prev->id());
+    }
+    return static_cast<size_t>(graph_->numNodes()) == order_.size();
+}
+
+void IncrementalCompiler::refreshLiveness(std::unordered_set<int>& redo) {
+    // a rewired edge can move a value's last reader; both readers and the
+    // producer annotate that value
+    auto before = std::move(liveness_);
+    liveness_ = codegen::CodeGenerator::analyzeLiveness(order_);
+    
+    auto stale = [&](int value_id) {
+        auto* value = graph_->getValue(value_id);
+        if (value && value->producer()) redo.insert(value->producer()->id());
+        auto old_reader = before.reader_of.find(value_id);
+        if (old_reader != before.reader_of.end()) redo.insert(old_reader->second);
+        auto new_reader = liveness_.reader_of.find(value_id);
+        if (new_reader != liveness_.reader_of.end()) redo.insert(new_reader->second);
+    };
+    for (const auto& entry : liveness_.reader_of) {
+        auto it = before.reader_of.find(entry.first);
+        if (it == before.reader_of.end() || it->second != entry.second) stale(entry.first);
+    }
+    for (const auto& entry : before.reader_of) {
+        if (!liveness_.reader_of.count(entry.first)) stale(entry.first);
+    }
+    for (int id : liveness_.output_ids) {
+        if (!before.output_ids.count(id)) stale(id);
+    }
+    for (int id : before.output_ids) {
+        if (!liveness_.output_ids.count(id)) stale(id);
+    }
+}
+
+void IncrementalCompiler::emit(size_t pos) {
+    segments_[pos].clear();
+    codegen_.generateForNode(order_[pos], prevCompute(pos), nextCompute(pos), segments_[pos]);
+    codegen_.annotateLiveness(order_[pos], liveness_, segments_[pos]);
+}
+
+void IncrementalCompiler::simulateFrom(size_t start, size_t last_emitted) {
+    // segments past the last re-emitted one are reused as soon as the
+    // simulator state entering them matches the previous run
+    for (size_t pos = start; pos < order_.size(); ++pos) {
+        raw_ -= node_stats_[pos];
+        erasePeak(sram_peaks_, node_stats_[pos].peak_sram_bytes);
+        erasePeak(activation_peaks_, node_stats_[pos].peak_activation_bytes);
+        erasePeak(working_set_peaks_, node_stats_[pos].peak_working_set_bytes);
+        
+        node_stats_[pos] = sim_.simulateSegment(segments_[pos]);
+        raw_ += node_stats_[pos];
+        sram_peaks_.insert(node_stats_[pos].peak_sram_bytes);
+        activation_peaks_.insert(node_stats_[pos].peak_activation_bytes);
+        working_set_peaks_.insert(node_stats_[pos].peak_working_set_bytes);
+        last_update_.resimulated++;
+        
+        auto state = sim_.state();
+        bool converged = pos > last_emitted && state == state_after_[pos];
+        state_after_[pos] = std::move(state);
+        if (converged) break;
+    }
+}
+
+void IncrementalCompiler::finalizeTotal() {
+    total_ = raw_;
+    total_.peak_sram_bytes = sram_peaks_.empty() ? 0 : *sram_peaks_.rbegin();
+    total_.peak_activation_bytes = activation_peaks_.empty() ? 0 : *activation_peaks_.rbegin();
+    total_.peak_working_set_bytes = working_set_peaks_.empty() ? 0 : *working_set_peaks_.rbegin();
+    if (!state_after_.empty()) {
+        // prefetches and async moves with no compute left to hide behind
+        total_.cycles += state_after_.back().pending();
+        total_.memory_cycles += state_after_.back().pending();
+        total_.contention_cycles += state_after_.back().pending();
+    }
+    total_.finalize(sim_.config().clock_freq_ghz);
+}
+
+ir::Node* IncrementalCompiler::prevCompute(size_t pos) const {
+    while (pos-- > 0) {
+        if (codegen::CodeGenerator::isComputeNode(order_[pos])) return order_[pos];
+    }
+    return nullptr;
+}
+
+ir::Node* IncrementalCompiler::nextCompute(size_t pos) const {
+    for (++pos; pos < order_.size(); ++pos) {
+        if (codegen::CodeGenerator::isComputeNode(order_[pos])) return order_[pos];
+    }
+    return nullptr;
+}
+
+}
+}
@@ -0,0 +1,122 @@
+#include "compiler/specialization.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace dlcompiler {
+namespace compiler {
+
+SpecializationCache::SpecializationCache(std::unique_ptr<ir::Graph> graph,
+                                         optimizer::Optimizer& opt, size_t max_exact)
+    : generic_(std::move(graph)), max_exact_(std::max<size_t>(max_exact, 1)) {
+    opt.run(generic_.get());
+
+    for (const auto& symbol : generic_->symbols()) {
+        symbols_.push_back(symbol);
+    }
+    buckets_.resize(symbols_.size());
+}
+
+void SpecializationCache::setBuckets(const std::string& symbol, std::vector<int64_t> sizes) {
+    auto it = std::find(symbols_.begin(), symbols_.end(), symbol);
+    if (it == symbols_.end()) {
+        throw std::runtime_error("graph has no shape symbol " + symbol);
+    }
+
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    buckets_[it - symbols_.begin()] = std::move(sizes);
+    
+    // shapes outside the old buckets may fall inside the new ones
+    variants_.clear();
+    exact_.clear();
+    exact_index_.clear();
+}
+
+void SpecializationCache::compile() {
+    size_t total = 1;
+    for (size_t i = 0; i < symbols_.size(); ++i) {
+        if (buckets_[i].empty()) {
+            throw std::runtime_error("no buckets for shape symbol " + symbols_[i]);
+        }
+        total *= buckets_[i].size();
+    }
+
+    std::cout << "\n ----> Compiling " << total << " shape variants <----\n";
+    variants_.clear();
+    variants_.reserve(total);
+
+    // walk bucket combinations in the same mixed-radix order lookup() uses
+    std::vector<size_t> idx(symbols_.size(), 0);
+    for (size_t n = 0; n < total; ++n) {
+        ir::Bindings bindings;
+        for (size_t i = 0; i < symbols_.size(); ++i) {
+            bindings[symbols_[i]] = buckets_[i][idx[i]];
+        }
+        variants_.push_back(compileVariant(bindings));
+
+        for (size_t i = symbols_.size(); i-- > 0;) {
+            if (++idx[i] < buckets_[i].size()) break;
+            idx[i] = 0;
+        }
+    }
+}
+
+const CompiledVariant& SpecializationCache::lookup(const ir::Bindings& bindings) {
+    size_t index = 0;
+    bool in_buckets = !variants_.empty();
+    std::vector<int64_t> key;
+    key.reserve(symbols_.size());
+
+    for (size_t i = 0; i < symbols_.size(); ++i) {
+        auto it = bindings.find(symbols_[i]);
+        if (it == bindings.end()) {
+            throw std::runtime_error("unbound shape symbol: " + symbols_[i]);
+        }
+        key.push_back(it->second);
+
+        // smallest bucket that fits
+        const auto& sizes = buckets_[i];
+        auto pos = std::lower_bound(sizes.begin(), sizes.end(), it->second);
+        if (pos == sizes.end()) {
+            in_buckets = false;
+            continue;
+        }
+        index = index * sizes.size() + (pos - sizes.begin());
+    }
+
+    if (in_buckets) {
+        bucket_hits_++;
+        return variants_[index];
+    }
+
+    // no bucket is large enough: codegen needs concrete dims, so compile
+    // this exact shape and keep the most recent ones
+    fallbacks_++;
+    auto it = exact_index_.find(key);
+    if (it != exact_index_.end()) {
+        exact_.splice(exact_.begin(), exact_, it->second);
+        return exact_.front().second;
+    }
+    
+    ir::Bindings exact;
+    for (size_t i = 0; i < symbols_.size(); ++i) {
+        exact[symbols_[i]] = key[i];
+    }
+    if (exact_.size() >= max_exact_) {
+        exact_index_.erase(exact_.back().first);
+        exact_.pop_back();
+        evictions_++;
+    }
+    exact_.emplace_front(key, compileVariant(exact));
+    exact_index_[key] = exact_.begin();
+    return exact_.front().second;
+}
+
+CompiledVariant SpecializationCache::compileVariant(const ir::Bindings& bindings) {
+    auto graph = generic_->specialize(bindings);
+    return {bindings, codegen_.generate(graph.get())};
+}
+
+}
+}
@@ -0,0 +1,197 @@
+#include "ir/autodiff.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace dlcompiler {
+namespace ir {
+
+namespace {
+
+Value* markBackward(Value* value) {
+    value->producer()->setAttr("backward", 1);
+    return value;
+}
+
+// forward tensors the backward of node needs to produce the gradients in wrt
+std::vector<Value*> savedTensors(const Node* node, const std::vector<int>& wrt) {
+    const auto& in = node->inputs();
+    auto* out = node->outputs()[0];
+    std::vector<Value*> saved;
+    
+    switch (node->type()) {
+        case OpType::CONV2D:
+        case OpType::FUSED_CONV_RELU:
+        case OpType::MATMUL:
+        case OpType::FUSED_MATMUL_ADD:
+            // dX needs W and dW needs X; the bias gradient only needs dY
+            for (int i : wrt) {
+                if (i < 2) saved.push_back(in[1 - i]);
+            }
+            if (node->type() == OpType::FUSED_CONV_RELU) saved.push_back(out); // relu mask
+            break;
+        
+        case OpType::RELU:
+        case OpType::SOFTMAX:
+            saved.push_back(out);
+            break;
+        
+        case OpType::GELU:
+        case OpType::MAXPOOL:
+            saved.push_back(in[0]);
+            break;
+        
+        case OpType::LAYERNORM:
+        case OpType::BATCHNORM:
+            // statistics are recomputed from x, dX also needs the scale
+            saved.push_back(in[0]);
+            if (in.size() > 1 && !wrt.empty() && wrt[0] == 0) saved.push_back(in[1]);
+            break;
+        
+        case OpType::FUSED_ATTENTION:
+            // scores are recomputed tile by tile, O gives the softmax correction term
+            saved = {in[0], in[1], in[2], out};
+            break;
+        
+        case OpType::ADD:
+            break; // broadcast operands only reduce dY
+        
+        default:
+            throw std::runtime_error("autodiff: no gradient for " + opTypeToString(node->type()));
+    }
+    return saved;
+}
+
+}
+
+BackwardGraph buildBackward(Graph* graph) {
+    BackwardGraph result;
+    auto forward = graph->getNodesInTopoOrder();
+    
+    // activations downstream of a parameter need gradients, data inputs don't
+    std::unordered_set<const Value*> needs_grad;
+    for (auto* node : forward) {
+        bool any = false;
+        for (auto* input : node->inputs()) {
+            any |= needs_grad.count(input) > 0;
+        }
+        for (auto* output : node->outputs()) {
+            if (output->isParameter() || any) needs_grad.insert(output);
+        }
+    }
+    
+    // partial gradients, summed when a value fans out
+    std::unordered_map<const Value*, std::vector<Value*>> partials;
+    auto gradOf = [&](const Value* value) -> Value* {
+        auto it = partials.find(value);
+        if (it == partials.end()) return nullptr;
+        Value* sum = it->second[0];
+        for (size_t i = 1; i < it->second.size(); ++i) {
+            sum = markBackward(graph->addAdd(sum, it->second[i]));
+        }
+        it->second = {sum};
+        return sum;
+    };
+    
+    for (auto* node : forward) {
+        if (node->type() != OpType::OUTPUT || !needs_grad.count(node->inputs()[0])) continue;
+        auto* seed = markBackward(graph->addInput(node->inputs()[0]->shape()));
+        result.output_grads.push_back(seed);
+        partials[node->inputs()[0]].push_back(seed);
+    }
+    
+    for (auto it = forward.rbegin(); it != forward.rend(); ++it) {
+        auto* node = *it;
+        if (node->type() == OpType::INPUT || node->type() == OpType::OUTPUT ||
+            node->type() == OpType::CONSTANT) {
+            continue;
+        }
+        
+        if (node->type() == OpType::SPLIT) {
+            if (!needs_grad.count(node->inputs()[0])) continue;
+            
+            // dX lays the piece gradients back side by side along axis;
+            // pieces that reach no output are marked zero_i and contribute zeros
+            std::vector<Value*> dys;
+            for (size_t i = 0; i < node->outputs().size(); ++i) {
+                if (auto* piece = gradOf(node->outputs()[i])) dys.push_back(piece);
+            }
+            if (dys.empty()) continue;
+            
+            auto grads = graph->addGradient(node, dys[0], {dys.begin() + 1, dys.end()}, {0});
+            auto* concat = grads[0]->producer();
+            for (size_t i = 0; i < node->outputs().size(); ++i) {
+                if (!partials.count(node->outputs()[i])) concat->setAttr("zero_" + std::to_string(i), 1);
+            }
+            partials[node->inputs()[0]].push_back(markBackward(grads[0]));
+            continue;
+        }
+        
+        auto* dy = gradOf(node->outputs()[0]);
+        if (!dy) continue; // doesn't reach any output
+        
+        std::vector<int> wrt;
+        for (size_t i = 0; i < node->inputs().size(); ++i) {
+            if (needs_grad.count(node->inputs()[i])) wrt.push_back(static_cast<int>(i));
+        }
+        if (wrt.empty()) continue;
+        
+        const auto& in = node->inputs();
+        switch (node->type()) {
+            case OpType::RESHAPE: {
+                // a view, so is its gradient
+                const auto& shape = in[0]->shape();
+                std::vector<int64_t> dims(shape.dims.begin(), shape.dims.end());
+                if (std::count(dims.begin(), dims.end(), Shape::kDynamic) > 1) {
+                    throw std::runtime_error("autodiff: reshape gradient needs at most one symbolic dim");
+                }
+                partials[in[0]].push_back(markBackward(graph->addReshape(dy, dims)));
+                break;
+            }
+            
+            case OpType::TRANSPOSE: {
+                std::vector<int64_t> inverse(node->getAttr("rank"));
+                for (size_t i = 0; i < inverse.size(); ++i) {
+                    inverse[node->getAttr("perm_" + std::to_string(i))] = i;
+                }
+                partials[in[0]].push_back(markBackward(graph->addTranspose(dy, inverse)));
+                break;
+            }
+            
+            default: {
+                // same-shape add passes dY straight through
+                std::vector<int> kernel_wrt;
+                for (int i : wrt) {
+                    if (node->type() == OpType::ADD && in[i]->shape() == dy->shape()) {
+                        partials[in[i]].push_back(dy);
+                    } else {
+                        kernel_wrt.push_back(i);
+                    }
+                }
+                if (kernel_wrt.empty()) break;
+                
+                auto grads = graph->addGradient(node, dy, savedTensors(node, kernel_wrt), kernel_wrt);
+                markBackward(grads[0]);
+                for (size_t i = 0; i < grads.size(); ++i) {
+                    partials[in[kernel_wrt[i]]].push_back(grads[i]);
+                }
+                break;
+            }
+        }
+    }
+    
+    // parameter gradients leave the step as outputs
+    for (auto* node : forward) {
+        if (node->type() != OpType::CONSTANT || !node->outputs()[0]->isParameter()) continue;
+        auto* param = node->outputs()[0];
+        auto* grad = gradOf(param);
+        if (!grad) continue;
+        markBackward(graph->addOutput(grad));
+        result.param_grads[param->id()] = grad;
+    }
+    
+    return result;
+}
+
+}
+}
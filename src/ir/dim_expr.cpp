@@ -0,0 +1,152 @@
+#include "ir/dim_expr.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace dlcompiler {
+namespace ir {
+
+struct DimExpr::Node {
+    Kind kind;
+    int64_t value = 0;
+    std::string name;
+    std::shared_ptr<const Node> lhs;
+    std::shared_ptr<const Node> rhs;
+};
+
+DimExpr::DimExpr(int64_t value) {
+    auto node = std::make_shared<Node>();
+    node->kind = Kind::CONST;
+    node->value = value;
+    node_ = std::move(node);
+}
+
+DimExpr DimExpr::symbol(const std::string& name) {
+    auto node = std::make_shared<Node>();
+    node->kind = Kind::SYMBOL;
+    node->name = name;
+    return DimExpr(std::shared_ptr<const Node>(std::move(node)));
+}
+
+bool DimExpr::isConstant() const {
+    return node_->kind == Kind::CONST;
+}
+
+int64_t DimExpr::constant() const {
+    return node_->value;
+}
+
+DimExpr DimExpr::binary(Kind kind, const DimExpr& lhs, const DimExpr& rhs) {
+    // fold constants and identities so static shapes stay static
+    if (lhs.isConstant() && rhs.isConstant()) {
+        int64_t a = lhs.constant();
+        int64_t b = rhs.constant();
+        switch (kind) {
+            case Kind::ADD: return DimExpr(a + b);
+            case Kind::SUB: return DimExpr(a - b);
+            case Kind::MUL: return DimExpr(a * b);
+            case Kind::DIV: return DimExpr(a / b);
+            default: break;
+        }
+    }
+    if (rhs.isConstant()) {
+        int64_t b = rhs.constant();
+        if ((kind == Kind::ADD || kind == Kind::SUB) && b == 0) return lhs;
+        if ((kind == Kind::MUL || kind == Kind::DIV) && b == 1) return lhs;
+    }
+    if (lhs.isConstant()) {
+        int64_t a = lhs.constant();
+        if (kind == Kind::ADD && a == 0) return rhs;
+        if (kind == Kind::MUL && a == 1) return rhs;
+    }
+
+    auto node = std::make_shared<Node>();
+    node->kind = kind;
+    node->lhs = lhs.node_;
+    node->rhs = rhs.node_;
+    return DimExpr(std::shared_ptr<const Node>(std::move(node)));
+}
+
+bool DimExpr::equal(const Node* lhs, const Node* rhs) {
+    if (lhs == rhs) return true; // shared subtrees, common after shape inference
+    if (lhs->kind != rhs->kind) return false;
+    switch (lhs->kind) {
+        case Kind::CONST: return lhs->value == rhs->value;
+        case Kind::SYMBOL: return lhs->name == rhs->name;
+        default: return equal(lhs->lhs.get(), rhs->lhs.get()) && equal(lhs->rhs.get(), rhs->rhs.get());
+    }
+}
+
+DimExpr DimExpr::floorDiv(const DimExpr& rhs) const {
+    return binary(Kind::DIV, *this, rhs);
+}
+
+DimExpr operator+(const DimExpr& lhs, const DimExpr& rhs) {
+    return DimExpr::binary(DimExpr::Kind::ADD, lhs, rhs);
+}
+
+DimExpr operator-(const DimExpr& lhs, const DimExpr& rhs) {
+    return DimExpr::binary(DimExpr::Kind::SUB, lhs, rhs);
+}
+
+DimExpr operator*(const DimExpr& lhs, const DimExpr& rhs) {
+    return DimExpr::binary(DimExpr::Kind::MUL, lhs, rhs);
+}
+
+int64_t DimExpr::evaluate(const Bindings& bindings) const {
+    switch (node_->kind) {
+        case Kind::CONST:
+            return node_->value;
+        case Kind::SYMBOL: {
+            auto it = bindings.find(node_->name);
+            if (it == bindings.end()) {
+                throw std::runtime_error("unbound shape symbol: " + node_->name);
+            }
+            return it->second;
+        }
+        default:
+            break;
+    }
+    
+    int64_t a = DimExpr(node_->lhs).evaluate(bindings);
+    int64_t b = DimExpr(node_->rhs).evaluate(bindings);
+    switch (node_->kind) {
+        case Kind::ADD: return a + b;
+        case Kind::SUB: return a - b;
+        case Kind::MUL: return a * b;
+        case Kind::DIV: return a / b;
+        default: break;
+    }
+    return 0;
+}
+
+void DimExpr::collectSymbols(std::set<std::string>& symbols) const {
+    switch (node_->kind) {
+        case Kind::CONST:
+            return;
+        case Kind::SYMBOL:
+            symbols.insert(node_->name);
+            return;
+        default:
+            DimExpr(node_->lhs).collectSymbols(symbols);
+            DimExpr(node_->rhs).collectSymbols(symbols);
+            return;
+    }
+}
+
+std::string DimExpr::toString() const {
+    std::stringstream ss;
+    std::string lhs = node_->lhs ? DimExpr(node_->lhs).toString() : "";
+    std::string rhs = node_->rhs ? DimExpr(node_->rhs).toString() : "";
+    switch (node_->kind) {
+        case Kind::CONST: ss << node_->value; break;
+        case Kind::SYMBOL: ss << node_->name; break;
+        case Kind::ADD: ss << "(" << lhs << " + " << rhs << ")"; break;
+        case Kind::SUB: ss << "(" << lhs << " - " << rhs << ")"; break;
+        case Kind::MUL: ss << lhs << "*" << rhs; break;
+        case Kind::DIV: ss << lhs << "/" << rhs; break;
+    }
+    return ss.str();
+}
+
+}
+}
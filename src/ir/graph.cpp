@@ -3,25 +3,80 @@
 #include <algorithm>
 #include <unordered_set>
 #include <iostream>
+#include <stdexcept>
 
 namespace dlcompiler {
 namespace ir {
 
+Shape::Shape(const std::vector<DimExpr>& d) {
+    bool all_static = true;
+    for (const auto& e : d) {
+        dims.push_back(e.isConstant() ? e.constant() : kDynamic);
+        all_static &= e.isConstant();
+    }
+    if (!all_static) exprs = d;
+}
+
+Shape Shape::bind(const Bindings& bindings) const {
+    if (isStatic()) return *this;
+    Shape bound;
+    for (const auto& e : exprs) {
+        bound.dims.push_back(e.evaluate(bindings));
+    }
+    return bound;
+}
+
+void Shape::collectSymbols(std::set<std::string>& symbols) const {
+    for (const auto& e : exprs) {
+        e.collectSymbols(symbols);
+    }
+}
+
+bool Shape::operator==(const Shape& other) const {
+    if (dims != other.dims || exprs.size() != other.exprs.size()) return false;
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        if (exprs[i] != other.exprs[i]) return false;
+    }
+    return true;
+}
+
 std::string Shape::toString() const {
     std::stringstream ss;
     ss << "[";
     for (size_t i = 0; i < dims.size(); ++i) {
-        ss << dims[i];
+        ss << dim(i).toString();
         if (i < dims.size() - 1) ss << ", ";
     }
     ss << "]";
     return ss.str();
 }
 
+std::string attentionShapeMismatch(const Shape& q, const Shape& k, const Shape& v) {
+    if (q.rank() < 2 || k.rank() != q.rank() || v.rank() != q.rank()) {
+        return "attention needs Q, K and V of one rank >= 2, got " + q.toString() + ", " +
+               k.toString() + ", " + v.toString();
+    }
+    size_t rank = q.rank();
+    for (size_t i = 0; i + 2 < rank; ++i) {
+        if (k.dim(i) != q.dim(i) || v.dim(i) != q.dim(i)) {
+            return "attention K/V heads " + k.toString() + ", " + v.toString() + 
+                   " don't match Q " + q.toString();
+        }
+    }
+    if (k.dim(rank - 1) != q.dim(rank - 1)) {
+        return "attention K width " + k.toString() + " doesn't match Q " + q.toString();
+    }
+    if (v.dim(rank - 2) != k.dim(rank - 2)) {
+        return "attention V length " + v.toString() + " doesn't match K " + k.toString();
+    }
+    return "";
+}
+
 std::string opTypeToString(OpType type) {
     switch (type) {
         case OpType::INPUT: return "Input";
         case OpType::OUTPUT: return "Output";
+        case OpType::CONSTANT: return "Constant";
         case OpType::CONV2D: return "Conv2D";
         case OpType::MATMUL: return "MatMul";
         case OpType::RELU: return "ReLU";
@@ -30,10 +85,92 @@ std::string opTypeToString(OpType type) {
         case OpType::BATCHNORM: return "BatchNorm";
         case OpType::FUSED_CONV_RELU: return "FusedConvReLU";
         case OpType::FUSED_MATMUL_ADD: return "FusedMatMulAdd";
+        case OpType::SOFTMAX: return "Softmax";
+        case OpType::LAYERNORM: return "LayerNorm";
+        case OpType::GELU: return "GELU";
+        case OpType::RESHAPE: return "Reshape";
+        case OpType::TRANSPOSE: return "Transpose";
+        case OpType::SPLIT: return "Split";
+        case OpType::FUSED_ATTENTION: return "FusedAttention";
+        case OpType::GRADIENT: return "Gradient";
         default: return "Unknown";
     }
 }
 
+Sparsity Sparsity::unstructured(double density) {
+    if (density <= 0 || density > 1) {
+        throw std::runtime_error("sparsity density must be in (0, 1]");
+    }
+    Sparsity s;
+    s.pattern = density < 1 ? SparsityPattern::UNSTRUCTURED : SparsityPattern::DENSE;
+    s.density = density;
+    return s;
+}
+
+Sparsity Sparsity::nOfM(int64_t n, int64_t m) {
+    if (n < 1 || n > m) {
+        throw std::runtime_error("n:m sparsity needs 1 <= n <= m");
+    }
+    Sparsity s;
+    s.pattern = n < m ? SparsityPattern::N_OF_M : SparsityPattern::DENSE;
+    s.n = n;
+    s.m = m;
+    s.density = static_cast<double>(n) / m;
+    return s;
+}
+
+Sparsity Sparsity::block(int64_t rows, int64_t cols, double density) {
+    if (rows < 1 || cols < 1) {
+        throw std::runtime_error("sparsity blocks must be at least 1x1");
+    }
+    Sparsity s = unstructured(density);
+    if (!s.isDense()) s.pattern = SparsityPattern::BLOCK;
+    s.block_rows = rows;
+    s.block_cols = cols;
+    return s;
+}
+
+std::string Sparsity::toString() const {
+    std::stringstream ss;
+    switch (pattern) {
+        case SparsityPattern::DENSE: return "dense";
+        case SparsityPattern::UNSTRUCTURED: ss << "unstructured"; break;
+        case SparsityPattern::N_OF_M: ss << n << ":" << m; break;
+        case SparsityPattern::BLOCK: ss << "block " << block_rows << "x" << block_cols; break;
+    }
+    ss << " @" << static_cast<int>(density * 100 + 0.5) << "%";
+    return ss.str();
+}
+
+const Value* Value::storage(bool through_splits) const {
+    const Value* value = this;
+    while (value->producer() && (value->producer()->type() == OpType::RESHAPE ||
+                                 (through_splits && value->producer()->type() == OpType::SPLIT))) {
+        value = value->producer()->inputs()[0];
+    }
+    return value;
+}
+
+void Node::setSparsity(const Sparsity& sparsity) {
+    setAttr("sparsity", static_cast<int64_t>(sparsity.pattern));
+    setAttr("sparse_n", sparsity.n);
+    setAttr("sparse_m", sparsity.m);
+    setAttr("sparse_block_rows", sparsity.block_rows);
+    setAttr("sparse_block_cols", sparsity.block_cols);
+    setAttr("sparse_density_ppm", static_cast<int64_t>(sparsity.density * 1e6 + 0.5));
+}
+
+Sparsity Node::sparsity() const {
+    Sparsity s;
+    s.pattern = static_cast<SparsityPattern>(getAttr("sparsity"));
+    s.n = getAttr("sparse_n");
+    s.m = getAttr("sparse_m");
+    s.block_rows = getAttr("sparse_block_rows", 1);
+    s.block_cols = getAttr("sparse_block_cols", 1);
+    s.density = getAttr("sparse_density_ppm", 1000000) / 1e6;
+    return s;
+}
+
 std::string Node::toString() const {
     std::stringstream ss;
     ss << "Node" << id_ << " [" << opTypeToString(type_) << "]";
@@ -48,6 +185,7 @@ std::string Node::toString() const {
         if (i < outputs_.size() - 1) ss << ", ";
     }
     ss << "]";
+    if (!sparsity().isDense()) ss << " sparsity=" << sparsity().toString();
     return ss.str();
 }
 
@@ -58,8 +196,8 @@ Node* Graph::createNode(OpType type) {
     return ptr;
 }
 
-Value* Graph::createValue(const Shape& shape) {
-    auto value = std::make_unique<Value>(next_value_id_++, shape);
+Value* Graph::createValue(const Shape& shape, int64_t elem_bytes) {
+    auto value = std::make_unique<Value>(next_value_id_++, shape, elem_bytes);
     auto* ptr = value.get();
     values_.push_back(std::move(value));
     return ptr;
@@ -80,23 +218,38 @@ Value* Graph::addOutput(Value* input) {
     return output;
 }
 
+Value* Graph::addConstant(const Shape& shape, int64_t elem_bytes) {
+    auto* node = createNode(OpType::CONSTANT);
+    auto value = std::make_unique<Value>(next_value_id_++, shape, elem_bytes);
+    auto* output = value.get();
+    values_.push_back(std::move(value));
+    output->setConstant(true);
+    node->addOutput(output);
+    return output;
+}
+
+Value* Graph::addParameter(const Shape& shape, int64_t elem_bytes) {
+    auto* output = addConstant(shape, elem_bytes);
+    output->setParameter(true);
+    return output;
+}
+
 Value* Graph::addConv2D(Value* input, int64_t out_channels, int64_t kernel_size,
                         int64_t stride, int64_t padding) {
+    // filter weights: [C_out, C_in, K, K], shaped by inferShape
+    auto* weight = addParameter({});
+    
     auto* node = createNode(OpType::CONV2D);
     node->addInput(input);
+    node->addInput(weight);
     node->setAttr("out_channels", out_channels);
     node->setAttr("kernel_size", kernel_size);
     node->setAttr("stride", stride);
     node->setAttr("padding", padding);
     
-    // compute output shape: [N, C_out, H_out, W_out]
-    const auto& in_shape = input->shape();
-    int64_t h_out = (in_shape.dims[2] + 2 * padding - kernel_size) / stride + 1;
-    int64_t w_out = (in_shape.dims[3] + 2 * padding - kernel_size) / stride + 1;
-    Shape out_shape = {in_shape.dims[0], out_channels, h_out, w_out};
-    
-    auto* output = createValue(out_shape);
+    auto* output = createValue({});
     node->addOutput(output);
+    inferShape(node);
     return output;
 }
 
@@ -105,13 +258,9 @@ Value* Graph::addMatMul(Value* a, Value* b) {
     node->addInput(a);
     node->addInput(b);
     
-    // compute output shape: [M, N] x [N, K] = [M, K]
-    const auto& a_shape = a->shape();
-    const auto& b_shape = b->shape();
-    Shape out_shape = {a_shape.dims[0], b_shape.dims[1]};
-    
-    auto* output = createValue(out_shape);
+    auto* output = createValue({});
     node->addOutput(output);
+    inferShape(node);
     return output;
 }
 
@@ -138,16 +287,380 @@ Value* Graph::addMaxPool(Value* input, int64_t kernel_size, int64_t stride) {
     node->setAttr("kernel_size", kernel_size);
     node->setAttr("stride", stride);
     
+    auto* output = createValue({});
+    node->addOutput(output);
+    inferShape(node);
+    return output;
+}
+
+Value* Graph::addSoftmax(Value* input) {
+    auto* node = createNode(OpType::SOFTMAX);
+    node->addInput(input);
+    auto* output = createValue(input->shape());
+    node->addOutput(output);
+    return output;
+}
+
+Value* Graph::addLayerNorm(Value* input) {
+    // per-feature scale and shift
+    const auto& in_shape = input->shape();
+    auto* gamma = addParameter({in_shape.dim(in_shape.rank() - 1)});
+    auto* beta = addParameter({in_shape.dim(in_shape.rank() - 1)});
+    
+    auto* node = createNode(OpType::LAYERNORM);
+    node->addInput(input);
+    node->addInput(gamma);
+    node->addInput(beta);
+    auto* output = createValue(input->shape());
+    node->addOutput(output);
+    return output;
+}
+
+Value* Graph::addGELU(Value* input) {
+    auto* node = createNode(OpType::GELU);
+    node->addInput(input);
+    auto* output = createValue(input->shape());
+    node->addOutput(output);
+    return output;
+}
+
+Value* Graph::addReshape(Value* input, const std::vector<int64_t>& dims) {
+    int64_t known = 1;
+    int inferred = 0;
+    for (auto d : dims) {
+        if (d == -1) inferred++;
+        else if (d < 1) throw std::invalid_argument("reshape dims must be positive or -1");
+        else known *= d;
+    }
+    if (inferred > 1) throw std::invalid_argument("reshape can infer at most one dim");
+    
+    // symbolic inputs are checked once their sizes are bound
+    int64_t numel = input->shape().numel();
+    if (numel != Shape::kDynamic && (inferred ? numel % known != 0 : numel != known)) {
+        throw std::invalid_argument("reshape to " + std::to_string(known) + " elements of " +
+                                    input->shape().toString() + " changes numel");
+    }
+    
+    auto* node = createNode(OpType::RESHAPE);
+    node->addInput(input);
+    node->setAttr("rank", dims.size());
+    for (size_t i = 0; i < dims.size(); ++i) {
+        node->setAttr("dim_" + std::to_string(i), dims[i]);
+    }
+    
+    auto* output = createValue({});
+    node->addOutput(output);
+    inferShape(node);
+    return output;
+}
+
+Value* Graph::addTranspose(Value* input, const std::vector<int64_t>& perm) {
+    size_t rank = input->shape().rank();
+    std::vector<bool> seen(rank, false);
+    if (perm.size() != rank) {
+        throw std::invalid_argument("transpose perm must list all " + std::to_string(rank) + " axes");
+    }
+    for (auto axis : perm) {
+        if (axis < 0 || axis >= static_cast<int64_t>(rank) || seen[axis]) {
+            throw std::invalid_argument("transpose perm is not a permutation of the axes");
+        }
+        seen[axis] = true;
+    }
+    
+    auto* node = createNode(OpType::TRANSPOSE);
+    node->addInput(input);
+    node->setAttr("rank", perm.size());
+    for (size_t i = 0; i < perm.size(); ++i) {
+        node->setAttr("perm_" + std::to_string(i), perm[i]);
+    }
+    
+    auto* output = createValue({});
+    node->addOutput(output);
+    inferShape(node);
+    return output;
+}
+
+std::vector<Value*> Graph::addSplit(Value* input, int64_t axis, 
+                                    const std::vector<int64_t>& sizes) {
     const auto& in_shape = input->shape();
-    int64_t h_out = (in_shape.dims[2] - kernel_size) / stride + 1;
-    int64_t w_out = (in_shape.dims[3] - kernel_size) / stride + 1;
-    Shape out_shape = {in_shape.dims[0], in_shape.dims[1], h_out, w_out};
+    if (axis < 0 || axis >= static_cast<int64_t>(in_shape.rank())) {
+        throw std::invalid_argument("split axis " + std::to_string(axis) + " out of range for " +
+                                    in_shape.toString());
+    }
+    if (sizes.empty()) throw std::invalid_argument("split needs at least one piece");
+    int64_t total = 0;
+    for (auto size : sizes) {
+        if (size < 1) throw std::invalid_argument("split sizes must be positive");
+        total += size;
+    }
+    DimExpr extent = in_shape.dim(axis);
+    if (extent.isConstant() && extent.constant() != total) {
+        throw std::invalid_argument("split sizes sum to " + std::to_string(total) + ", axis " +
+                                    std::to_string(axis) + " has " +
+                                    std::to_string(extent.constant()));
+    }
+    
+    auto* node = createNode(OpType::SPLIT);
+    node->addInput(input);
+    node->setAttr("axis", axis);
+    node->setAttr("num_outputs", sizes.size());
+    
+    std::vector<Value*> outputs;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        node->setAttr("size_" + std::to_string(i), sizes[i]);
+        auto* output = createValue({}, input->elemBytes());
+        node->addOutput(output);
+        outputs.push_back(output);
+    }
+    inferShape(node);
+    return outputs;
+}
+
+Value* Graph::addAttention(Value* q, Value* k, Value* v) {
+    std::string mismatch = attentionShapeMismatch(q->shape(), k->shape(), v->shape());
+    if (!mismatch.empty()) throw std::invalid_argument(mismatch);
     
-    auto* output = createValue(out_shape);
+    auto* node = createNode(OpType::FUSED_ATTENTION);
+    node->addInput(q);
+    node->addInput(k);
+    node->addInput(v);
+    
+    auto* output = createValue({});
     node->addOutput(output);
+    inferShape(node);
     return output;
 }
 
+std::vector<Value*> Graph::addGradient(const Node* forward, Value* grad_output,
+                                       const std::vector<Value*>& saved,
+                                       const std::vector<int>& wrt) {
+    auto* node = createNode(OpType::GRADIENT);
+    for (const auto& attr : forward->getAttrs()) {
+        node->setAttr(attr.first, attr.second);
+    }
+    node->setAttr("fwd_op", static_cast<int64_t>(forward->type()));
+    node->setAttr("num_grads", wrt.size());
+    
+    node->addInput(grad_output);
+    for (auto* value : saved) {
+        node->addInput(value);
+    }
+    
+    // each gradient is shaped like the forward input it belongs to
+    std::vector<Value*> grads;
+    for (size_t i = 0; i < wrt.size(); ++i) {
+        node->setAttr("wrt_" + std::to_string(i), wrt[i]);
+        auto* input = forward->inputs()[wrt[i]];
+        auto* grad = createValue(input->shape(), input->elemBytes());
+        node->addOutput(grad);
+        grads.push_back(grad);
+    }
+    return grads;
+}
+
+Node* Graph::cloneNode(const Node* node, const std::vector<Value*>& inputs) {
+    auto* copy = createNode(node->type());
+    for (const auto& attr : node->getAttrs()) {
+        copy->setAttr(attr.first, attr.second);
+    }
+    for (auto* input : inputs) {
+        copy->addInput(input);
+    }
+    for (auto* output : node->outputs()) {
+        auto* value = createValue(output->shape(), output->elemBytes());
+        value->setConstant(output->isConstant());
+        value->setParameter(output->isParameter());
+        copy->addOutput(value);
+    }
+    return copy;
+}
+
+bool Graph::inferShape(Node* node) {
+    if (node->outputs().empty() || node->inputs().empty()) {
+        return false; // inputs and constants keep the shape they were given
+    }
+    if (node->type() == OpType::GRADIENT) {
+        return false; // shaped like the forward inputs when created
+    }
+    if (node->type() == OpType::SPLIT) {
+        // every output keeps the input shape except along axis
+        const auto& in_shape = node->inputs()[0]->shape();
+        int64_t axis = node->getAttr("axis");
+        bool changed = false;
+        for (size_t i = 0; i < node->outputs().size(); ++i) {
+            std::vector<DimExpr> dims;
+            for (size_t d = 0; d < in_shape.rank(); ++d) dims.push_back(in_shape.dim(d));
+            dims[axis] = node->getAttr("size_" + std::to_string(i));
+            
+            Shape piece(dims);
+            if (node->outputs()[i]->shape() != piece) {
+                node->outputs()[i]->setShape(piece);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+    
+    Shape out_shape;
+    switch (node->type()) {
+        case OpType::CONV2D:
+        case OpType::FUSED_CONV_RELU: {
+            // output shape: [N, C_out, H_out, W_out]
+            const auto& in_shape = node->inputs()[0]->shape();
+            int64_t out_channels = node->getAttr("out_channels");
+            int64_t kernel_size = node->getAttr("kernel_size", 3);
+            int64_t stride = node->getAttr("stride", 1);
+            int64_t padding = node->getAttr("padding", 0);
+            
+            if (node->inputs().size() > 1 && node->inputs()[1]->isConstant()) {
+                node->inputs()[1]->setShape({DimExpr(out_channels), in_shape.dim(1),
+                                             DimExpr(kernel_size), DimExpr(kernel_size)});
+            }
+            
+            DimExpr h_out = (in_shape.dim(2) + 2 * padding - kernel_size).floorDiv(stride) + 1;
+            DimExpr w_out = (in_shape.dim(3) + 2 * padding - kernel_size).floorDiv(stride) + 1;
+            out_shape = {in_shape.dim(0), DimExpr(out_channels), h_out, w_out};
+            break;
+        }
+        
+        case OpType::MATMUL:
+        case OpType::FUSED_MATMUL_ADD: {
+            // output shape: [..., M, K] x [..., K, N] = [..., M, N], batch
+            // dims broadcast and a rank-2 operand is shared by every batch
+            const auto& a_shape = node->inputs()[0]->shape();
+            const auto& b_shape = node->inputs()[1]->shape();
+            const auto& batch = a_shape.rank() >= b_shape.rank() ? a_shape : b_shape;
+            const auto& other = a_shape.rank() >= b_shape.rank() ? b_shape : a_shape;
+            size_t offset = batch.rank() - other.rank();
+            
+            std::vector<DimExpr> dims;
+            for (size_t i = 0; i + 2 < batch.rank(); ++i) {
+                DimExpr d = batch.dim(i);
+                if (i >= offset && d.isConstant() && d.constant() == 1) d = other.dim(i - offset);
+                dims.push_back(d);
+            }
+            dims.push_back(a_shape.dim(a_shape.rank() - 2));
+            dims.push_back(b_shape.dim(b_shape.rank() - 1));
+            out_shape = Shape(dims);
+            break;
+        }
+        
+        case OpType::RESHAPE: {
+            const auto& in_shape = node->inputs()[0]->shape();
+            DimExpr numel = 1;
+            for (size_t i = 0; i < in_shape.rank(); ++i) numel = numel * in_shape.dim(i);
+            
+            int64_t rank = node->getAttr("rank");
+            int64_t known = 1;
+            int64_t inferred = -1;
+            for (int64_t i = 0; i < rank; ++i) {
+                int64_t d = node->getAttr("dim_" + std::to_string(i));
+                if (d == -1) inferred = i;
+                else known *= d;
+            }
+            
+            std::vector<DimExpr> dims;
+            for (int64_t i = 0; i < rank; ++i) {
+                if (i == inferred) dims.push_back(numel.floorDiv(known));
+                else dims.push_back(node->getAttr("dim_" + std::to_string(i)));
+            }
+            out_shape = Shape(dims);
+            break;
+        }
+        
+        case OpType::TRANSPOSE: {
+            const auto& in_shape = node->inputs()[0]->shape();
+            std::vector<DimExpr> dims;
+            for (int64_t i = 0; i < node->getAttr("rank"); ++i) {
+                dims.push_back(in_shape.dim(node->getAttr("perm_" + std::to_string(i))));
+            }
+            out_shape = Shape(dims);
+            break;
+        }
+        
+        case OpType::FUSED_ATTENTION: {
+            // [..., S, D_v]
+            const auto& q_shape = node->inputs()[0]->shape();
+            const auto& v_shape = node->inputs()[2]->shape();
+            std::vector<DimExpr> dims;
+            for (size_t i = 0; i + 1 < q_shape.rank(); ++i) dims.push_back(q_shape.dim(i));
+            dims.push_back(v_shape.dim(v_shape.rank() - 1));
+            out_shape = Shape(dims);
+            break;
+        }
+        
+        case OpType::MAXPOOL: {
+            const auto& in_shape = node->inputs()[0]->shape();
+            int64_t kernel_size = node->getAttr("kernel_size", 2);
+            int64_t stride = node->getAttr("stride", 2);
+            DimExpr h_out = (in_shape.dim(2) - kernel_size).floorDiv(stride) + 1;
+            DimExpr w_out = (in_shape.dim(3) - kernel_size).floorDiv(stride) + 1;
+            out_shape = {in_shape.dim(0), in_shape.dim(1), h_out, w_out};
+            break;
+        }
+        
+        default:
+            // elementwise: output follows the first input
+            out_shape = node->inputs()[0]->shape();
+            break;
+    }
+    
+    auto* output = node->outputs()[0];
+    if (output->shape() == out_shape) {
+        return false;
+    }
+    output->setShape(out_shape);
+    return true;
+}
+
+Node* Graph::getNode(int id) const {
+    // nodes_ stays sorted by id, removal leaves gaps
+    auto it = std::lower_bound(nodes_.begin(), nodes_.end(), id,
+        [](const std::unique_ptr<Node>& n, int key) { return n->id() < key; });
+    if (it == nodes_.end() || (*it)->id() != id) return nullptr;
+    return it->get();
+}
+
+std::vector<Node*> Graph::getUsers(const Value* v) const {
+    std::vector<Node*> users;
+    for (const auto& node : nodes_) {
+        for (auto* input : node->inputs()) {
+            if (input == v) {
+                users.push_back(node.get());
+                break;
+            }
+        }
+    }
+    return users;
+}
+
+void Graph::removeNode(Node* node) {
+    nodes_.erase(std::remove_if(nodes_.begin(), nodes_.end(),
+        [node](const std::unique_ptr<Node>& n) { return n.get() == node; }),
+        nodes_.end());
+}
+
+void Graph::removeNodes(const std::unordered_set<Node*>& nodes) {
+    if (nodes.empty()) return;
+    nodes_.erase(std::remove_if(nodes_.begin(), nodes_.end(),
+        [&nodes](const std::unique_ptr<Node>& n) { return nodes.count(n.get()) > 0; }),
+        nodes_.end());
+}
+
+void Graph::removeValues(const std::unordered_set<Value*>& values) {
+    if (values.empty()) return;
+    values_.erase(std::remove_if(values_.begin(), values_.end(),
+        [&values](const std::unique_ptr<Value>& v) { return values.count(v.get()) > 0; }),
+        values_.end());
+}
+
+Value* Graph::getValue(int id) const {
+    // ids are handed out in order and removal keeps it
+    auto it = std::lower_bound(values_.begin(), values_.end(), id,
+        [](const std::unique_ptr<Value>& v, int target) { return v->id() < target; });
+    return it != values_.end() && (*it)->id() == id ? it->get() : nullptr;
+}
+
 std::vector<Node*> Graph::getNodes() const {
     std::vector<Node*> result;
     for (const auto& node : nodes_) {
@@ -158,13 +671,68 @@ std::vector<Node*> Graph::getNodes() const {
 
 std::vector<Node*> Graph::getNodesInTopoOrder() const {
     std::vector<Node*> result;
-    std::unordered_set<int> visited;
+    result.reserve(nodes_.size());
     
-    // simple sort
+    std::unordered_set<const Node*> live;
     for (const auto& node : nodes_) {
-        if (visited.find(node->id()) == visited.end()) {
-            result.push_back(node.get());
-            visited.insert(node->id());
+        live.insert(node.get());
+    }
+    
+    // post-order dfs over producers, seeded in insertion order so graphs
+    // built front to back come out unchanged; iterative for deep chains
+    std::unordered_set<const Node*> visited;
+    std::vector<std::pair<Node*, size_t>> stack;
+    for (const auto& node : nodes_) {
+        if (!visited.insert(node.get()).second) continue;
+        stack.push_back({node.get(), 0});
+        
+        while (!stack.empty()) {
+            Node* current = stack.back().first;
+            size_t idx = stack.back().second++;
+            if (idx < current->inputs().size()) {
+                Node* producer = current->inputs()[idx]->producer();
+                if (producer && live.count(producer) && visited.insert(producer).second) {
+                    stack.push_back({producer, 0});
+                }
+            } else {
+                result.push_back(current);
+                stack.pop_back();
+            }
+        }
+    }
+    
+    return result;
+}
+
+std::set<std::string> Graph::symbols() const {
+    std::set<std::string> result;
+    for (const auto& value : values_) {
+        value->shape().collectSymbols(result);
+    }
+    return result;
+}
+
+std::unique_ptr<Graph> Graph::specialize(const Bindings& bindings) const {
+    auto result = Graph::create();
+    std::unordered_map<const Value*, Value*> value_map;
+    
+    for (auto* node : getNodesInTopoOrder()) {
+        auto* copy = result->createNode(node->type());
+        for (const auto& attr : node->getAttrs()) {
+            copy->setAttr(attr.first, attr.second);
+        }
+        for (auto* input : node->inputs()) {
+            copy->addInput(value_map.at(input));
+        }
+        for (auto* output : node->outputs()) {
+            auto value = std::make_unique<Value>(result->next_value_id_++, 
+                                                 output->shape().bind(bindings),
+                                                 output->elemBytes());
+            value->setConstant(output->isConstant());
+            value->setParameter(output->isParameter());
+            value_map[output] = value.get();
+            copy->addOutput(value.get());
+            result->values_.push_back(std::move(value));
         }
     }
     
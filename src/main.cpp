@@ -1,9 +1,21 @@
 #include "ir/graph.h"
+#include "ir/autodiff.h"
 #include "optimizer/optimizer.h"
 #include "codegen/codegen.h"
 #include "simulator/simulator.h"
+#include "compiler/specialization.h"
+#include "compiler/cost_model.h"
+#include "compiler/incremental.h"
+#include "codegen/cpp_emitter.h"
+#include "simulator/calibration.h"
+#include "support/quiet_stdout.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
 
 using namespace dlcompiler;
 
@@ -19,46 +31,544 @@ void runEx() {
     graph->print();
     
     optimizer::Optimizer opt;
+    opt.addPass(std::make_unique<optimizer::ConstantFoldingPass>());
     opt.addPass(std::make_unique<optimizer::FusionPass>());
     opt.addPass(std::make_unique<optimizer::MemoryLayoutPass>());
+    opt.addPass(std::make_unique<optimizer::DeadCodeEliminationPass>());
     opt.run(graph.get());
     
     std::cout << "\nOptimized Graph:\n";
     graph->print();
     
-    // Generate code
-    codegen::CodeGenerator codegen;
-    auto instructions = codegen.generate(graph.get());
-    
-    // simulate on different hardware configs
+    // generate code for and simulate on different hardware configs
     simulator::ChipConfig high_end{
         .compute_units = 32,
         .memory_bandwidth_gb_s = 200,
-        .cache_size_kb = 512,
+        .scratchpad_kb = 64,
         .simd_width = 16,
         .clock_freq_ghz = 2.0
     };
     simulator::Simulator sim1(high_end);
-    auto stats1 = sim1.execute(instructions);
+    auto stats1 = sim1.execute(codegen::CodeGenerator(high_end).generate(graph.get()));
     
     simulator::ChipConfig low_end{
         .compute_units = 4,
         .memory_bandwidth_gb_s = 50,
-        .cache_size_kb = 128,
+        .scratchpad_kb = 32,
         .simd_width = 4,
         .clock_freq_ghz = 1.0
     };
     simulator::Simulator sim2(low_end);
-    auto stats2 = sim2.execute(instructions);
+    auto stats2 = sim2.execute(codegen::CodeGenerator(low_end).generate(graph.get()));
     
     std::cout << "\nSpeedup from high-end chip: " 
               << (stats2.execution_time_ms / stats1.execution_time_ms) << "x\n";
 }
 
+void runFCEx(const simulator::ChipConfig& base) {
+    
+    // batch-1 MLP: weight traffic dominates
+    auto graph = ir::Graph::create();
+    auto input = graph->addInput({1, 1024});
+    auto w1 = graph->addConstant({1024, 4096});
+    auto b1 = graph->addAdd(graph->addConstant({1, 4096}), 
+                            graph->addConstant({1, 4096})); // folded
+    auto h = graph->addReLU(graph->addAdd(graph->addMatMul(input, w1), b1));
+    auto w2 = graph->addConstant({4096, 1000});
+    auto output = graph->addOutput(graph->addMatMul(h, w2));
+    (void)output;
+    
+    optimizer::Optimizer opt;
+    opt.addPass(std::make_unique<optimizer::ConstantFoldingPass>());
+    opt.addPass(std::make_unique<optimizer::FusionPass>());
+    opt.addPass(std::make_unique<optimizer::DeadCodeEliminationPass>());
+    opt.run(graph.get());
+    
+    std::cout << "\nOptimized MLP Graph:\n";
+    graph->print();
+    
+    simulator::ChipConfig config = base;
+    config.weight_buffer_kb = 32 * 1024;
+    codegen::CodeGenerator codegen(config);
+    auto instructions = codegen.generate(graph.get());
+    simulator::Simulator sim(config);
+    sim.execute(instructions);
+}
+
+void runDynamicEx() {
+    
+    // sequence length only known at serving time
+    auto seq = ir::DimExpr::symbol("S");
+    auto graph = ir::Graph::create();
+    auto input = graph->addInput({seq, ir::DimExpr(512)});
+    auto w = graph->addConstant({512, 512});
+    auto output = graph->addOutput(graph->addReLU(graph->addMatMul(input, w)));
+    (void)output;
+    
+    optimizer::Optimizer opt;
+    opt.addPass(std::make_unique<optimizer::FusionPass>());
+    opt.addPass(std::make_unique<optimizer::DeadCodeEliminationPass>());
+    
+    compiler::SpecializationCache cache(std::move(graph), opt);
+    cache.setBuckets("S", {128, 256, 512});
+    cache.compile();
+    
+    for (int64_t s : {100, 200, 512, 1000, 1000}) {
+        const auto& variant = cache.lookup({{"S", s}});
+        std::cout << "S=" << s << " -> variant S=" << variant.bindings.at("S") 
+                  << " (" << variant.instructions.size() << " instructions)\n";
+    }
+    std::cout << "Variants: " << cache.numVariants() 
+              << ", bucket hits: " << cache.bucketHits() 
+              << ", exact fallbacks: " << cache.fallbacks() << "\n";
+}
+
+void runIncrementalEx(const simulator::ChipConfig& base) {
+    
+    // ~50k-node conv stack, then tweak one layer in the middle
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, 16, 32, 32});
+    std::vector<ir::Node*> convs;
+    while (graph->numNodes() < 50000) {
+        x = graph->addConv2D(x, 16, 3, 1, 1);
+        convs.push_back(graph->getNode(graph->numNodes() - 1));
+        x = graph->addReLU(x);
+    }
+    graph->addOutput(x);
+    
+    optimizer::Optimizer opt;
+    opt.addPass(std::make_unique<optimizer::ConstantFoldingPass>());
+    opt.addPass(std::make_unique<optimizer::FusionPass>());
+    opt.addPass(std::make_unique<optimizer::MemoryLayoutPass>());
+    
+    compiler::IncrementalCompiler inc(graph.get(), opt, base);
+    
+    std::cout << "\n ----> Incremental Recompilation <----\n";
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        QuietStdout quiet; // one line per fused conv
+        inc.compile();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    
+    // 5x5 kernel with padding 2 keeps the output shape, only this layer changes
+    auto* conv = convs[convs.size() / 2];
+    inc.setAttr(conv, "kernel_size", 5);
+    inc.setAttr(conv, "padding", 2);
+    const auto& stats = inc.update();
+    auto t2 = std::chrono::steady_clock::now();
+    
+    auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << "Graph nodes:         " << graph->numNodes() << "\n";
+    std::cout << "Full compile:        " << ms(t1 - t0) << " ms\n";
+    std::cout << "Incremental update:  " << ms(t2 - t1) << " ms ("
+              << inc.lastUpdate().reoptimized << " reoptimized, "
+              << inc.lastUpdate().reemitted << " re-emitted, "
+              << inc.lastUpdate().resimulated << " re-simulated)\n";
+    std::cout << "Total cycles:        " << stats.cycles << "\n";
+}
+
+// single transformer block: layernorm, 4-head self-attention, GELU MLP
+std::unique_ptr<ir::Graph> buildTransformerBlock() {
+    const int64_t seq = 512, model = 256, heads = 4, head_dim = 64;
+    
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, seq, model});
+    auto h = graph->addLayerNorm(x);
+    
+    // [1, S, model] -> [1, heads, S, head_dim]
+    auto project = [&](ir::Value* in) {
+        auto proj = graph->addMatMul(in, graph->addConstant({model, model}));
+        auto split = graph->addReshape(proj, {1, seq, heads, head_dim});
+        return graph->addTranspose(split, {0, 2, 1, 3});
+    };
+    auto q = project(h);
+    auto k = project(h);
+    auto v = project(h);
+    
+    auto scores = graph->addMatMul(q, graph->addTranspose(k, {0, 1, 3, 2}));
+    auto attn = graph->addMatMul(graph->addSoftmax(scores), v);
+    
+    auto merged = graph->addReshape(graph->addTranspose(attn, {0, 2, 1, 3}), {1, seq, model});
+    auto out = graph->addMatMul(merged, graph->addConstant({model, model}));
+    
+    auto mlp = graph->addLayerNorm(out);
+    mlp = graph->addGELU(graph->addMatMul(mlp, graph->addConstant({model, 4 * model})));
+    mlp = graph->addMatMul(mlp, graph->addConstant({4 * model, model}));
+    graph->addOutput(mlp);
+    return graph;
+}
+
+void runAttentionEx(const simulator::ChipConfig& base) {
+    
+    simulator::ChipConfig config = base;
+    config.weight_buffer_kb = 4 * 1024;
+    
+    auto simulate = [&](bool fuse) {
+        auto graph = buildTransformerBlock();
+        optimizer::Optimizer opt;
+        if (fuse) opt.addPass(std::make_unique<optimizer::FusionPass>());
+        opt.addPass(std::make_unique<optimizer::DeadCodeEliminationPass>());
+        opt.run(graph.get());
+        
+        codegen::CodeGenerator codegen(config);
+        simulator::Simulator sim(config);
+        return sim.execute(codegen.generate(graph.get()));
+    };
+    
+    std::cout << "\n ----> Transformer Block: unfused attention <----\n";
+    auto unfused = simulate(false);
+    std::cout << "\n ----> Transformer Block: fused attention <----\n";
+    auto fused = simulate(true);
+    
+    std::cout << "\nFused attention saves " 
+              << (unfused.memory_traffic_bytes - fused.memory_traffic_bytes) / 1024 
+              << " KB of memory traffic, peak working set " << unfused.peak_working_set_bytes / 1024 
+              << " KB -> " << fused.peak_working_set_bytes / 1024 << " KB (tiled SRAM " 
+              << unfused.peak_sram_bytes / 1024 << " KB -> " << fused.peak_sram_bytes / 1024 
+              << " KB), cycles " 
+              << unfused.cycles << " -> " << fused.cycles << "\n";
+}
+
+// Inception-style block: parallel 1x1 convs over one input
+std::unique_ptr<ir::Graph> buildInceptionBlock() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({8, 192, 28, 28});
+    auto b1 = graph->addReLU(graph->addConv2D(x, 64, 1, 1, 0));
+    auto b2 = graph->addReLU(graph->addConv2D(x, 96, 1, 1, 0));
+    auto b3 = graph->addReLU(graph->addConv2D(x, 16, 1, 1, 0));
+    b2 = graph->addReLU(graph->addConv2D(b2, 128, 3, 1, 1));
+    b3 = graph->addReLU(graph->addConv2D(b3, 32, 5, 1, 2));
+    graph->addOutput(b1);
+    graph->addOutput(b2);
+    graph->addOutput(b3);
+    return graph;
+}
+
+void runHorizontalEx(const simulator::ChipConfig& base) {
+    
+    simulator::ChipConfig config = base;
+    config.weight_buffer_kb = 4 * 1024;
+    
+    auto simulate = [&](std::unique_ptr<ir::Graph> graph, bool horizontal) {
+        optimizer::Optimizer opt;
+        opt.addPass(std::make_unique<optimizer::FusionPass>());
+        if (horizontal) {
+            opt.addPass(std::make_unique<optimizer::HorizontalFusionPass>(
+                std::make_shared<compiler::SimulatedCost>(config)));
+        }
+        opt.addPass(std::make_unique<optimizer::DeadCodeEliminationPass>());
+        opt.run(graph.get());
+        
+        codegen::CodeGenerator codegen(config);
+        simulator::Simulator sim(config);
+        return sim.execute(codegen.generate(graph.get()));
+    };
+    
+    auto report = [](const std::string& name, const simulator::ExecutionStats& before,
+                     const simulator::ExecutionStats& after) {
+        std::cout << "\n" << name << ": launches " << before.kernel_launches << " -> " 
+                  << after.kernel_launches << ", activation loads " 
+                  << before.activation_bytes_loaded / 1024 << " KB -> " 
+                  << after.activation_bytes_loaded / 1024 << " KB, cycles " 
+                  << before.cycles << " -> " << after.cycles << "\n";
+    };
+    
+    std::cout << "\n ----> Inception Block: separate 1x1 convs <----\n";
+    auto inception = simulate(buildInceptionBlock(), false);
+    std::cout << "\n ----> Inception Block: horizontally fused <----\n";
+    auto inception_fused = simulate(buildInceptionBlock(), true);
+    
+    std::cout << "\n ----> Transformer Block: separate Q/K/V projections <----\n";
+    auto qkv = simulate(buildTransformerBlock(), false);
+    std::cout << "\n ----> Transformer Block: horizontally fused <----\n";
+    auto qkv_fused = simulate(buildTransformerBlock(), true);
+    
+    report("Inception 1x1 branches", inception, inception_fused);
+    report("Q/K/V projections", qkv, qkv_fused);
+}
+
+// mixed kernel sizes: 7x7/2 stem, 3x3 and 1x1 stages, a 5x5 branch
+std::unique_ptr<ir::Graph> buildConvNet(int64_t batch = 8) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({batch, 3, 224, 224});
+    x = graph->addReLU(graph->addConv2D(x, 64, 7, 2, 3));
+    x = graph->addMaxPool(x, 2, 2);
+    x = graph->addReLU(graph->addConv2D(x, 64, 1, 1, 0));
+    x = graph->addReLU(graph->addConv2D(x, 128, 3, 1, 1));
+    x = graph->addReLU(graph->addConv2D(x, 128, 3, 1, 1));
+    x = graph->addMaxPool(x, 2, 2);
+    x = graph->addReLU(graph->addConv2D(x, 256, 3, 1, 1));
+    x = graph->addReLU(graph->addConv2D(x, 64, 1, 1, 0));
+    x = graph->addReLU(graph->addConv2D(x, 32, 5, 1, 2));
+    graph->addOutput(x);
+    return graph;
+}
+
+void runConvAlgorithmEx(const simulator::ChipConfig& base) {
+    
+    simulator::ChipConfig config = base;
+    config.weight_buffer_kb = 4 * 1024;
+    
+    auto simulate = [&](bool force_direct) {
+        auto graph = buildConvNet();
+        optimizer::Optimizer opt;
+        opt.addPass(std::make_unique<optimizer::FusionPass>());
+        opt.run(graph.get());
+        
+        codegen::CodeGenerator codegen(config);
+        if (force_direct) codegen.forceConvAlgorithm(codegen::ConvAlgorithm::DIRECT);
+        simulator::Simulator sim(config);
+        return sim.execute(codegen.generate(graph.get()));
+    };
+    
+    std::cout << "\n ----> ConvNet: direct convolution only <----\n";
+    auto direct = simulate(true);
+    std::cout << "\n ----> ConvNet: per-layer algorithm selection <----\n";
+    auto selected = simulate(false);
+    
+    std::cout << "\nConv algorithm selection: " << direct.cycles << " -> " << selected.cycles 
+              << " cycles (" << std::fixed << std::setprecision(2) 
+              << static_cast<double>(direct.cycles) / selected.cycles << "x)\n";
+}
+
+// FFN stack with every weight pruned the same way
+std::unique_ptr<ir::Graph> buildPrunedMLP(int64_t tokens, const ir::Sparsity& sparsity) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({tokens, 1024});
+    int64_t widths[] = {2048, 2048, 1024};
+    int64_t in = 1024;
+    for (int64_t width : widths) {
+        auto y = graph->addMatMul(x, graph->addConstant({in, width}));
+        y->producer()->setSparsity(sparsity);
+        x = graph->addReLU(graph->addAdd(y, graph->addConstant({tokens, width})));
+        in = width;
+    }
+    graph->addOutput(x);
+    return graph;
+}
+
+void runSparsityEx(const simulator::ChipConfig& base) {
+    
+    simulator::ChipConfig cpu = base;
+    cpu.weight_buffer_kb = 16 * 1024;
+    
+    // 2:4 sparse tensor cores, better gather units
+    simulator::ChipConfig sparse_core = cpu;
+    sparse_core.sparse_n = 2;
+    sparse_core.sparse_m = 4;
+    sparse_core.sparse_gather_efficiency = 0.3;
+    
+    std::vector<std::pair<std::string, simulator::ChipConfig>> targets = {
+        {"cpu", cpu}, {"2:4 sparse core", sparse_core}
+    };
+    std::vector<ir::Sparsity> patterns = {
+        ir::Sparsity(),
+        ir::Sparsity::nOfM(2, 4),
+        ir::Sparsity::block(4, 8, 0.5),
+        ir::Sparsity::unstructured(0.5),
+        ir::Sparsity::unstructured(0.1)
+    };
+    
+    std::stringstream table;
+    table << std::fixed << std::setprecision(2);
+    for (int64_t tokens : {256, 1}) {
+        for (const auto& target : targets) {
+            int64_t dense_cycles = 0;
+            for (const auto& sparsity : patterns) {
+                auto graph = buildPrunedMLP(tokens, sparsity);
+                optimizer::Optimizer opt;
+                opt.addPass(std::make_unique<optimizer::FusionPass>());
+                opt.run(graph.get());
+                
+                std::cout << "\n ----> " << tokens << " tokens, " << sparsity.toString() 
+                          << " weights on " << target.first << " <----\n";
+                codegen::CodeGenerator codegen(target.second);
+                simulator::Simulator sim(target.second);
+                auto stats = sim.execute(codegen.generate(graph.get()));
+                if (sparsity.isDense()) dense_cycles = stats.cycles;
+                
+                table << "  " << std::setw(4) << tokens << " tokens  " << std::left 
+                      << std::setw(16) << target.first << std::setw(22) << sparsity.toString() 
+                      << std::right << std::setw(6) 
+                      << static_cast<double>(dense_cycles) / stats.cycles << "x  "
+                      << std::setw(6) << stats.weight_bytes_loaded / 1024 << " KB weights ("
+                      << stats.sparse_index_bytes / 1024 << " KB index)\n";
+            }
+        }
+    }
+    
+    std::cout << "\nSpeedup over dense weights:\n" << table.str();
+}
+
+void runMemoryHierarchyEx(const simulator::ChipConfig& base) {
+    
+    // single-image conv net across scratchpad and L2 sizes
+    std::stringstream table;
+    table << std::fixed << std::setprecision(1);
+    for (int scratchpad_kb : {16, 64, 256}) {
+        for (int l2_kb : {512, 2048, 8192}) {
+            simulator::ChipConfig config = base;
+            config.weight_buffer_kb = 4 * 1024;
+            config.scratchpad_kb = scratchpad_kb;
+            config.l2_size_kb = l2_kb;
+            
+            auto graph = buildConvNet(1);
+            optimizer::Optimizer opt;
+            opt.addPass(std::make_unique<optimizer::FusionPass>());
+            opt.run(graph.get());
+            
+            std::cout << "\n ----> ConvNet: " << scratchpad_kb << " KB scratchpads, " 
+                      << l2_kb << " KB L2 <----\n";
+            codegen::CodeGenerator codegen(config);
+            simulator::Simulator sim(config);
+            auto stats = sim.execute(codegen.generate(graph.get()));
+            
+            table << "  " << std::setw(4) << scratchpad_kb << " KB  " << std::setw(5) << l2_kb 
+                  << " KB  " << std::setw(10) << stats.cycles << " cycles  " 
+                  << std::setw(6) << stats.dram_bytes / (1024.0 * 1024.0) << " MB DRAM  L2 hits "
+                  << std::setw(5) << 100.0 * stats.cache_hits / 
+                                     std::max<int64_t>(1, stats.cache_hits + stats.cache_misses) 
+                  << "%  row hits " << std::setw(5) << 100.0 * stats.dram_row_hits / 
+                                     std::max<int64_t>(1, stats.dram_row_hits + stats.dram_row_misses) 
+                  << "%  stalls " << stats.l2_stall_cycles + stats.dram_stall_cycles + 
+                                     stats.contention_cycles << "\n";
+        }
+    }
+    
+    std::cout << "\nScratchpad per CU, L2 size:\n" << table.str();
+}
+
+// deep equal-width CNN plus its backward pass: every layer's activation is
+// saved for backward, so memory peaks where backward starts
+std::unique_ptr<ir::Graph> buildTrainingStep() {
+    auto graph = ir::Graph::create();
+    auto h = graph->addInput({16, 3, 32, 32});
+    h = graph->addReLU(graph->addConv2D(h, 32, 3, 1, 1));
+    for (int i = 0; i < 12; ++i) {
+        h = graph->addReLU(graph->addConv2D(h, 32, 3, 1, 1));
+    }
+    h = graph->addMaxPool(h, 2, 2);
+    h = graph->addReshape(h, {16, -1});
+    h = graph->addReLU(graph->addAdd(graph->addMatMul(h, graph->addParameter({32 * 16 * 16, 256})),
+                                     graph->addParameter({16, 256})));
+    graph->addOutput(graph->addMatMul(h, graph->addParameter({256, 10})));
+    
+    optimizer::Optimizer opt;
+    opt.addPass(std::make_unique<optimizer::FusionPass>());
+    opt.run(graph.get());
+    ir::buildBackward(graph.get());
+    return graph;
+}
+
+void runTrainingEx(const simulator::ChipConfig& base) {
+    
+    simulator::ChipConfig config = base;
+    config.weight_buffer_kb = 4 * 1024;
+    
+    struct Policy {
+        std::string name;
+        double budget_fraction; // of the keep-everything peak, < 0 keeps everything
+    };
+    std::vector<Policy> policies = {{"keep all", -1}, {"85% budget", 0.85}, 
+                                    {"75% budget", 0.75}, {"recompute max", 0}};
+    
+    int64_t keep_all_peak = 0;
+    std::vector<std::pair<std::string, std::string>> rows;
+    for (const auto& policy : policies) {
+        std::cout << "\n ----> Training Step: " << policy.name << " <----\n";
+        auto graph = buildTrainingStep();
+        
+        int64_t extra_flops = 0;
+        if (policy.budget_fraction >= 0) {
+            auto budget = static_cast<int64_t>(keep_all_peak * policy.budget_fraction);
+            auto remat = std::make_unique<optimizer::RematerializationPass>(budget);
+            auto* pass = remat.get();
+            optimizer::Optimizer opt;
+            opt.addPass(std::move(remat));
+            opt.run(graph.get());
+            extra_flops = pass->extraFLOPs();
+        }
+        
+        codegen::CodeGenerator codegen(config);
+        simulator::Simulator sim(config);
+        auto stats = sim.execute(codegen.generate(graph.get()));
+        if (policy.budget_fraction < 0) keep_all_peak = stats.peak_activation_bytes;
+        
+        std::stringstream row;
+        row << std::fixed << std::setprecision(2) << stats.execution_time_ms << " ms, peak "
+            << stats.peak_activation_bytes / (1024.0 * 1024.0) << " MB, +" 
+            << extra_flops / 1e9 << " GFLOPs recomputed";
+        rows.push_back({policy.name, row.str()});
+    }
+    
+    std::cout << "\nStep time and activation memory per policy:\n";
+    for (const auto& row : rows) {
+        std::cout << "  " << std::left << std::setw(15) << row.first << row.second << "\n";
+    }
+}
+
+void emitCppEx(const std::string& path) {
+    
+    // small conv net, compiled ahead of time to a standalone C++ file
+    auto graph = ir::Graph::create();
+    auto input = graph->addInput({1, 3, 32, 32});
+    auto x = graph->addReLU(graph->addConv2D(input, 16, 3, 1, 1));
+    x = graph->addMaxPool(x, 2, 2);
+    x = graph->addReLU(graph->addConv2D(x, 32, 3, 1, 1));
+    graph->addOutput(x);
+    
+    optimizer::Optimizer opt;
+    opt.addPass(std::make_unique<optimizer::FusionPass>());
+    opt.addPass(std::make_unique<optimizer::DeadCodeEliminationPass>());
+    opt.run(graph.get());
+    
+    codegen::CppEmitter emitter;
+    std::ofstream out(path);
+    out << emitter.emit(graph.get());
+    std::cout << "Wrote " << path << " (arena " 
+              << emitter.plan().arena_floats * sizeof(float) << " bytes)\n";
+}
+
+void calibrateEx(const std::string& path) {
+    
+    // fit the simulator to this machine and check it on held-out shapes
+    simulator::Calibrator calibrator;
+    auto result = calibrator.run();
+    result.print();
+    result.config.save(path);
+    std::cout << "Wrote " << path << ", run the demos on it with --config " << path << "\n";
+}
+
 int main(int argc, char** argv) {
     
     try {
+        if (argc == 3 && std::strcmp(argv[1], "--emit-cpp") == 0) {
+            emitCppEx(argv[2]);
+            return 0;
+        }
+        if (argc == 3 && std::strcmp(argv[1], "--calibrate") == 0) {
+            calibrateEx(argv[2]);
+            return 0;
+        }
+        
+        // demos start from this target, e.g. one written by --calibrate
+        simulator::ChipConfig base;
+        if (argc == 3 && std::strcmp(argv[1], "--config") == 0) {
+            base = simulator::ChipConfig::load(argv[2]);
+            std::cout << "Loaded target config " << argv[2] << "\n";
+        }
+
         runEx();
+        runFCEx(base);
+        runDynamicEx();
+        runIncrementalEx(base);
+        runAttentionEx(base);
+        runTrainingEx(base);
+        runHorizontalEx(base);
+        runConvAlgorithmEx(base);
+        runSparsityEx(base);
+        runMemoryHierarchyEx(base);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
         return 1;
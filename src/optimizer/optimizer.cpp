@@ -1,4 +1,7 @@
 #include "optimizer/optimizer.h"
+#include "support/quiet_stdout.h"
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <unordered_set>
 
@@ -15,72 +18,421 @@ void Optimizer::run(ir::Graph* graph) {
     std::cout << " ----> Optimization Complete <----\n\n";
 }
 
-bool FusionPass::run(ir::Graph* graph) {
+bool Optimizer::runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                            RegionState& state) {
     bool changed = false;
-    changed |= fuseConvReLU(graph);
-    changed |= fuseMatMulAdd(graph);
+    for (auto& pass : passes_) {
+        changed |= pass->runOnRegion(graph, region, state);
+    }
     return changed;
 }
 
-bool FusionPass::fuseConvReLU(ir::Graph* graph) {
-    bool changed = false;
+bool Optimizer::localizes() const {
+    for (const auto& pass : passes_) {
+        if (!pass->localizes()) return false;
+    }
+    return true;
+}
+
+FusionPass::FusionPass() {
+    using ir::OpType;
+    
+    // Conv2D -> ReLU, conv result not read by anything else
+    rules_.add({
+        "conv_relu",
+        Pattern::op(OpType::RELU).operands({
+            Pattern::op(OpType::CONV2D).singleUse().bind("conv")
+        }),
+        [](Rewriter& rw, const Match& m) {
+            auto* conv = m.node("conv");
+            rw.setType(conv, OpType::FUSED_CONV_RELU);
+            rw.replaceAllUsesWith(m.root->outputs()[0], conv->outputs()[0]);
+            rw.eraseNode(m.root);
+            std::cout << "  Fused Conv2D + ReLU into FusedConvReLU\n";
+            return true;
+        }
+    });
+    
+    // MatMul + bias in either operand order; bias becomes a third input
+    rules_.add({
+        "matmul_add",
+        Pattern::op(OpType::ADD).operands({
+            Pattern::op(OpType::MATMUL).singleUse().bind("matmul"),
+            Pattern::any().bind("bias")
+        }).commutative(),
+        [](Rewriter& rw, const Match& m) {
+            auto* matmul = m.node("matmul");
+            if (m.root->outputs()[0]->shape() != matmul->outputs()[0]->shape()) {
+                return false; // add broadcasts the matmul result
+            }
+            rw.setType(matmul, OpType::FUSED_MATMUL_ADD);
+            rw.addInput(matmul, m.value("bias"));
+            rw.replaceAllUsesWith(m.root->outputs()[0], matmul->outputs()[0]);
+            rw.eraseNode(m.root);
+            std::cout << "  Fused MatMul + Add into FusedMatMulAdd\n";
+            return true;
+        }
+    });
+    
+    // softmax(Q K^T) V -> one attention op; scores and probabilities never
+    // leave the chip
+    auto swaps_last_two = [](const ir::Node* node) {
+        int64_t rank = node->getAttr("rank");
+        if (rank < 2) return false;
+        for (int64_t i = 0; i < rank - 2; ++i) {
+            if (node->getAttr("perm_" + std::to_string(i)) != i) return false;
+        }
+        return node->getAttr("perm_" + std::to_string(rank - 2)) == rank - 1 &&
+               node->getAttr("perm_" + std::to_string(rank - 1)) == rank - 2;
+    };
+    rules_.add({
+        "attention",
+        Pattern::op(OpType::MATMUL).operands({
+            Pattern::op(OpType::SOFTMAX).singleUse().bind("softmax").operands({
+                Pattern::op(OpType::MATMUL).singleUse().bind("scores").operands({
+                    Pattern::any().bind("q"),
+                    Pattern::op(OpType::TRANSPOSE).where(swaps_last_two).bind("kt").operands({
+                        Pattern::any().bind("k")
+                    })
+                })
+            }),
+            Pattern::any().bind("v")
+        }),
+        [](Rewriter& rw, const Match& m) {
+            // K/V shared across heads broadcast in the batched matmuls, but
+            // the fused kernel walks one K/V per query head
+            if (!ir::attentionShapeMismatch(m.value("q")->shape(), m.value("k")->shape(),
+                                            m.value("v")->shape()).empty()) {
+                return false;
+            }
+            rw.setType(m.root, OpType::FUSED_ATTENTION);
+            rw.setInputs(m.root, {m.value("q"), m.value("k"), m.value("v")});
+            rw.eraseNode(m.node("softmax"));
+            rw.eraseNode(m.node("scores"));
+            
+            // K^T may still feed something else
+            auto* kt = m.node("kt");
+            auto it = rw.uses().find(kt->outputs()[0]);
+            if (it == rw.uses().end() || it->second.empty()) {
+                rw.eraseNode(kt);
+            }
+            std::cout << "  Fused MatMul + Softmax + MatMul into FusedAttention\n";
+            return true;
+        },
+        2
+    });
+}
+
+bool FusionPass::run(ir::Graph* graph) {
+    return PatternRewriteDriver(rules_).run(graph) > 0;
+}
+
+bool FusionPass::runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                             RegionState& state) {
+    return PatternRewriteDriver(rules_).run(graph, region, state) > 0;
+}
+
+bool HorizontalFusionPass::run(ir::Graph* graph) {
+    using ir::OpType;
+    
     auto nodes = graph->getNodesInTopoOrder();
+    Users users;
+    for (auto* node : nodes) {
+        for (auto* input : node->inputs()) {
+            users[input].push_back(node);
+        }
+    }
+    auto singleUse = [&](const ir::Value* value) {
+        return users[value].size() == 1;
+    };
     
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        auto* node = nodes[i];
+    // siblings can merge when they differ only in their output width
+    auto signature = [&](const ir::Node* node, const ir::Value* shared) -> std::string {
+        const auto& in = node->inputs();
+        if (in.size() < 2 || in[0] != shared || !in[1]->isConstant() || !singleUse(in[1])) return "";
         
-        // look for Conv2D followed by ReLU
-        if (node->type() == ir::OpType::CONV2D && node->outputs().size() == 1) {
-            auto* conv_output = node->outputs()[0];
+        // pruned weights only concatenate with the same pattern
+        std::string key = std::to_string(static_cast<int>(node->type())) + "/" + 
+                          node->sparsity().toString();
+        switch (node->type()) {
+            case OpType::CONV2D:
+            case OpType::FUSED_CONV_RELU:
+                if (in.size() != 2) return "";
+                return key + "/" + std::to_string(node->getAttr("kernel_size", 3)) + "/" +
+                       std::to_string(node->getAttr("stride", 1)) + "/" + 
+                       std::to_string(node->getAttr("padding", 0)) + "/" +
+                       std::to_string(node->getAttr("layout_nhwc"));
+            
+            case OpType::MATMUL:
+            case OpType::FUSED_MATMUL_ADD: {
+                if (in[1]->shape().rank() != 2) return "";
+                if (node->type() == OpType::FUSED_MATMUL_ADD) {
+                    // only a per-column bias can be concatenated
+                    auto* bias = in[2];
+                    if (!bias->isConstant() || !singleUse(bias) ||
+                        bias->shape().numel() != in[1]->shape().dims[1]) {
+                        return "";
+                    }
+                }
+                return key;
+            }
             
-            // find nodes that use this output
-            for (size_t j = i + 1; j < nodes.size(); ++j) {
-                auto* next_node = nodes[j];
+            default:
+                return "";
+        }
+    };
+    
+    std::unordered_set<ir::Node*> erased;
+    int merged = 0;
+    for (auto* node : nodes) {
+        for (auto* shared : node->outputs()) {
+            // group siblings in first-use order
+            std::vector<std::string> keys;
+            std::unordered_map<std::string, std::vector<ir::Node*>> groups;
+            for (auto* user : users[shared]) {
+                std::string key = signature(user, shared);
+                if (key.empty()) continue;
+                if (!groups.count(key)) keys.push_back(key);
+                groups[key].push_back(user);
+            }
+            
+            for (const auto& key : keys) {
+                const auto& group = groups[key];
+                if (group.size() < 2) continue;
+                
+                auto* first = group[0];
+                if (cost_) {
+                    int64_t apart = groupCycles(shared, group, users, false);
+                    int64_t together = groupCycles(shared, group, users, true);
+                    if (together >= apart) {
+                        std::cout << "  Kept " << group.size() << " sibling " 
+                                  << ir::opTypeToString(first->type()) << " apart, merged is "
+                                  << together - apart << " cycles slower\n";
+                        continue;
+                    }
+                }
                 
-                if (next_node->type() == ir::OpType::RELU && 
-                    next_node->inputs().size() == 1 &&
-                    next_node->inputs()[0] == conv_output) {
+                bool conv = first->type() == OpType::CONV2D || first->type() == OpType::FUSED_CONV_RELU;
+                std::vector<int64_t> widths;
+                int64_t total = 0;
+                for (auto* sibling : group) {
+                    widths.push_back(conv ? sibling->getAttr("out_channels") 
+                                          : sibling->inputs()[1]->shape().dims[1]);
+                    total += widths.back();
+                }
+                
+                // wide op over the concatenated weights
+                ir::Value* wide;
+                if (conv) {
+                    wide = graph->addConv2D(shared, total, first->getAttr("kernel_size", 3),
+                                            first->getAttr("stride", 1), first->getAttr("padding", 0));
+                } else {
+                    auto* weight = first->inputs()[1];
+                    wide = graph->addMatMul(shared, graph->addConstant({weight->shape().dims[0], total},
+                                                                       weight->elemBytes()));
+                }
+                auto* fused = wide->producer();
+                for (const auto& attr : first->getAttrs()) {
+                    if (attr.first != "out_channels") fused->setAttr(attr.first, attr.second);
+                }
+                fused->setType(first->type());
+                if (first->type() == OpType::FUSED_MATMUL_ADD) {
+                    auto dims = first->inputs()[2]->shape().dims;
+                    dims.back() = total;
+                    std::vector<ir::DimExpr> bias_dims(dims.begin(), dims.end());
+                    fused->addInput(graph->addConstant(ir::Shape(bias_dims), 
+                                                       first->inputs()[2]->elemBytes()));
+                }
+                // the wide weights train if the ones they replace did
+                for (size_t j = 1; j < fused->inputs().size(); ++j) {
+                    fused->inputs()[j]->setParameter(first->inputs()[j]->isParameter());
+                }
+                
+                auto pieces = graph->addSplit(wide, conv ? 1 : wide->shape().rank() - 1, widths);
+                for (size_t i = 0; i < group.size(); ++i) {
+                    auto* old = group[i]->outputs()[0];
+                    for (auto* user : users[old]) {
+                        for (size_t j = 0; j < user->inputs().size(); ++j) {
+                            if (user->inputs()[j] == old) user->setInput(j, pieces[i]);
+                        }
+                    }
+                    users[pieces[i]] = std::move(users[old]);
+                    users.erase(old);
                     
-                    // fuse! change Conv2D to FusedConvReLU
-                    node->setType(ir::OpType::FUSED_CONV_RELU);
-                    std::cout << "  Fused Conv2D + ReLU into FusedConvReLU\n";
+                    // the per-sibling weights are dead now
+                    for (size_t j = 1; j < group[i]->inputs().size(); ++j) {
+                        erased.insert(group[i]->inputs()[j]->producer());
+                    }
+                    erased.insert(group[i]);
+                }
+                
+                std::cout << "  Fused " << group.size() << " sibling " 
+                          << ir::opTypeToString(first->type()) << " into one wide "
+                          << ir::opTypeToString(first->type()) << " + Split\n";
+                merged++;
+            }
+        }
+    }
+    
+    graph->removeNodes(erased);
+    return merged > 0;
+}
+
+int64_t HorizontalFusionPass::groupCycles(const ir::Value* shared, const std::vector<ir::Node*>& group,
+                                          const Users& users, bool merged) const {
+    // the group on its own: a fresh shared input, the siblings over fresh
+    // weights and each output's readers through reshape views; other operands
+    // of a reader become inputs of their own
+    auto graph = ir::Graph::create();
+    auto* x = graph->addInput(shared->shape());
+    auto copy = [&](const ir::Node* node, const ir::Value* from, ir::Value* to) {
+        std::vector<ir::Value*> inputs;
+        for (auto* input : node->inputs()) {
+            if (input == from) {
+                inputs.push_back(to);
+            } else {
+                inputs.push_back(input->isConstant() ? graph->addConstant(input->shape(), input->elemBytes())
+                                                     : graph->addInput(input->shape()));
+            }
+        }
+        return graph->cloneNode(node, inputs);
+    };
+    
+    std::function<void(const ir::Value*, ir::Value*)> copyReaders;
+    copyReaders = [&](const ir::Value* from, ir::Value* to) {
+        auto it = users.find(from);
+        if (it == users.end()) return;
+        for (auto* reader : it->second) {
+            if (reader->type() == ir::OpType::OUTPUT) {
+                graph->addOutput(to);
+                continue;
+            }
+            auto* clone = copy(reader, from, to);
+            for (size_t i = 0; i < clone->outputs().size(); ++i) {
+                if (reader->type() == ir::OpType::RESHAPE) {
+                    copyReaders(reader->outputs()[i], clone->outputs()[i]);
+                } else {
+                    graph->addOutput(clone->outputs()[i]);
+                }
+            }
+        }
+    };
+    for (auto* sibling : group) {
+        auto* clone = copy(sibling, shared, x);
+        copyReaders(sibling->outputs()[0], clone->outputs()[0]);
+    }
+    
+    QuietStdout quiet;
+    if (merged) HorizontalFusionPass().run(graph.get());
+    return cost_->cycles(graph.get());
+}
+
+bool MemoryLayoutPass::run(ir::Graph* graph) {
+    RegionState state;
+    return runOnRegion(graph, graph->getNodesInTopoOrder(), state);
+}
+
+bool MemoryLayoutPass::runOnRegion(ir::Graph*, const std::vector<ir::Node*>& region,
+                                   RegionState&) {
+    bool changed = false;
+    
+    // spatial ops run channels-last so SIMD lanes walk contiguous channels
+    for (auto* node : region) {
+        switch (node->type()) {
+            case ir::OpType::CONV2D:
+            case ir::OpType::FUSED_CONV_RELU:
+            case ir::OpType::MAXPOOL:
+                if (node->getAttr("layout_nhwc") == 0) {
+                    node->setAttr("layout_nhwc", 1);
                     changed = true;
-                    
-                    break;
                 }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    return changed;
+}
+
+bool ConstantFoldingPass::run(ir::Graph* graph) {
+    RegionState state;
+    return runOnRegion(graph, graph->getNodesInTopoOrder(), state);
+}
+
+bool ConstantFoldingPass::runOnRegion(ir::Graph*, const std::vector<ir::Node*>& region,
+                                      RegionState& state) {
+    bool changed = false;
+    
+    for (auto* node : region) {
+        if (node->type() == ir::OpType::INPUT || 
+            node->type() == ir::OpType::OUTPUT ||
+            node->type() == ir::OpType::CONSTANT ||
+            node->inputs().empty()) {
+            continue;
+        }
+        
+        bool all_constant = true;
+        for (auto* input : node->inputs()) {
+            if (!input->isConstant()) {
+                all_constant = false;
+                break;
             }
         }
+        if (!all_constant) continue;
+        
+        // result is known at compile time: node becomes a constant producer
+        std::cout << "  Folded " << ir::opTypeToString(node->type()) 
+                  << " (node " << node->id() << ") into Constant\n";
+        node->setType(ir::OpType::CONSTANT);
+        for (auto* input : node->inputs()) {
+            auto it = state.uses.find(input);
+            if (it == state.uses.end()) continue;
+            auto& users = it->second;
+            users.erase(std::remove(users.begin(), users.end(), node), users.end());
+        }
+        node->clearInputs();
+        state.touched.insert(node->id());
+        for (auto* output : node->outputs()) {
+            output->setConstant(true);
+        }
+        changed = true;
     }
     
     return changed;
 }
 
-bool FusionPass::fuseMatMulAdd(ir::Graph* graph) {
+bool DeadCodeEliminationPass::run(ir::Graph* graph) {
     bool changed = false;
-    auto nodes = graph->getNodesInTopoOrder();
+    bool removed = true;
     
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        auto* node = nodes[i];
+    while (removed) {
+        removed = false;
+        
+        std::unordered_set<const ir::Value*> used;
+        for (auto* node : graph->getNodes()) {
+            for (auto* input : node->inputs()) {
+                used.insert(input);
+            }
+        }
         
-        // look for MatMul followed by add
-        if (node->type() == ir::OpType::MATMUL && node->outputs().size() == 1) {
-            auto* matmul_output = node->outputs()[0];
+        for (auto* node : graph->getNodesInTopoOrder()) {
+            if (node->type() == ir::OpType::OUTPUT ||
+                node->type() == ir::OpType::INPUT) continue;
             
-            for (size_t j = i + 1; j < nodes.size(); ++j) {
-                auto* next_node = nodes[j];
-                
-                if (next_node->type() == ir::OpType::ADD && 
-                    next_node->inputs().size() == 2 &&
-                    (next_node->inputs()[0] == matmul_output || 
-                     next_node->inputs()[1] == matmul_output)) {
-                    
-                    // fuse! change MatMul to FusedMatMulAdd
-                    node->setType(ir::OpType::FUSED_MATMUL_ADD);
-                    std::cout << "  Fused MatMul + Add into FusedMatMulAdd\n";
-                    changed = true;
+            bool live = false;
+            for (auto* output : node->outputs()) {
+                if (used.count(output)) {
+                    live = true;
                     break;
                 }
             }
+            
+            if (!live) {
+                graph->removeNode(node);
+                removed = true;
+                changed = true;
+            }
         }
     }
     
@@ -89,4 +441,3 @@ bool FusionPass::fuseMatMulAdd(ir::Graph* graph) {
 
 }
 }
-
@@ -0,0 +1,286 @@
+#include "optimizer/pattern.h"
+#include <algorithm>
+
+namespace dlcompiler {
+namespace optimizer {
+
+Pattern Pattern::op(ir::OpType type) {
+    Pattern p;
+    p.type_ = type;
+    return p;
+}
+
+Pattern Pattern::any() {
+    Pattern p;
+    p.wildcard_ = true;
+    return p;
+}
+
+Pattern& Pattern::operands(std::vector<Pattern> operands) {
+    operands_ = std::move(operands);
+    return *this;
+}
+
+Pattern& Pattern::commutative() {
+    commutative_ = true;
+    return *this;
+}
+
+Pattern& Pattern::attrEq(const std::string& key, int64_t value) {
+    preds_.push_back([key, value](const ir::Node* node) {
+        return node->getAttr(key) == value;
+    });
+    return *this;
+}
+
+Pattern& Pattern::where(std::function<bool(const ir::Node*)> pred) {
+    preds_.push_back(std::move(pred));
+    return *this;
+}
+
+Pattern& Pattern::singleUse() {
+    single_use_ = true;
+    return *this;
+}
+
+Pattern& Pattern::bind(const std::string& name) {
+    name_ = name;
+    return *this;
+}
+
+bool Pattern::match(ir::Node* node, const UseMap& uses, Match& m) const {
+    if (node->type() != type_) return false;
+    
+    if (single_use_) {
+        if (node->outputs().size() != 1) return false;
+        auto it = uses.find(node->outputs()[0]);
+        if (it == uses.end() || it->second.size() != 1) return false;
+    }
+    
+    for (const auto& pred : preds_) {
+        if (!pred(node)) return false;
+    }
+    
+    if (!operands_.empty()) {
+        if (node->inputs().size() != operands_.size()) return false;
+        
+        Match attempt = m;
+        if (matchOperands(node, uses, attempt, false)) {
+            m = std::move(attempt);
+        } else if (commutative_ && operands_.size() == 2) {
+            attempt = m;
+            if (!matchOperands(node, uses, attempt, true)) return false;
+            m = std::move(attempt);
+        } else {
+            return false;
+        }
+    }
+    
+    if (!name_.empty()) m.nodes[name_] = node;
+    return true;
+}
+
+bool Pattern::matchOperands(ir::Node* node, const UseMap& uses, Match& m, bool swapped) const {
+    for (size_t i = 0; i < operands_.size(); ++i) {
+        size_t idx = swapped ? operands_.size() - 1 - i : i;
+        if (!operands_[i].matchOperand(node->inputs()[idx], uses, m)) return false;
+    }
+    return true;
+}
+
+bool Pattern::matchOperand(ir::Value* value, const UseMap& uses, Match& m) const {
+    if (wildcard_) {
+        if (!name_.empty()) m.values[name_] = value;
+        return true;
+    }
+    
+    auto* producer = value->producer();
+    return producer && match(producer, uses, m);
+}
+
+Rewriter::Rewriter(ir::Graph* graph, Worklist& worklist)
+    : graph_(graph), worklist_(worklist), state_(owned_) {
+    for (auto* node : graph->getNodes()) {
+        for (auto* input : node->inputs()) {
+            owned_.uses[input].push_back(node);
+        }
+    }
+}
+
+Rewriter::Rewriter(ir::Graph* graph, Worklist& worklist, RegionState& state)
+    : graph_(graph), worklist_(worklist), state_(state) {}
+
+void Rewriter::setType(ir::Node* node, ir::OpType type) {
+    node->setType(type);
+    state_.touched.insert(node->id());
+    notifyChanged(node);
+}
+
+void Rewriter::addInput(ir::Node* node, ir::Value* value) {
+    node->addInput(value);
+    state_.uses[value].push_back(node);
+    state_.touched.insert(node->id());
+    notifyChanged(node);
+}
+
+void Rewriter::setInputs(ir::Node* node, const std::vector<ir::Value*>& values) {
+    for (auto* input : node->inputs()) {
+        auto& users = state_.uses[input];
+        users.erase(std::remove(users.begin(), users.end(), node), users.end());
+        if (input->producer()) notifyChanged(input->producer());
+    }
+    node->clearInputs();
+    
+    for (auto* value : values) {
+        node->addInput(value);
+        state_.uses[value].push_back(node);
+    }
+    state_.touched.insert(node->id());
+    notifyChanged(node);
+}
+
+void Rewriter::replaceAllUsesWith(ir::Value* from, ir::Value* to) {
+    auto users = std::move(state_.uses[from]);
+    state_.uses.erase(from);
+    
+    for (auto* user : users) {
+        for (size_t i = 0; i < user->inputs().size(); ++i) {
+            if (user->inputs()[i] == from) user->setInput(i, to);
+        }
+        state_.uses[to].push_back(user);
+        state_.touched.insert(user->id());
+        notifyChanged(user);
+    }
+}
+
+void Rewriter::eraseNode(ir::Node* node) {
+    for (auto* input : node->inputs()) {
+        auto& users = state_.uses[input];
+        users.erase(std::remove(users.begin(), users.end(), node), users.end());
+        
+        // producer may now be single-use and match something new
+        if (input->producer()) notifyChanged(input->producer());
+    }
+    node->clearInputs();
+    erased_.insert(node);
+}
+
+ir::Node* Rewriter::cloneNode(const ir::Node* node, const std::vector<ir::Value*>& inputs) {
+    auto* copy = graph_->cloneNode(node, inputs);
+    for (auto* input : inputs) {
+        state_.uses[input].push_back(copy);
+    }
+    state_.added.push_back(copy);
+    notifyChanged(copy);
+    return copy;
+}
+
+void Rewriter::notifyChanged(ir::Node* node) {
+    worklist_.push(node->id());
+    
+    // patterns are rooted at consumers, so they may now match too
+    for (auto* output : node->outputs()) {
+        auto it = state_.uses.find(output);
+        if (it == state_.uses.end()) continue;
+        for (auto* user : it->second) {
+            worklist_.push(user->id());
+        }
+    }
+}
+
+void Rewriter::commit() {
+    for (auto* node : erased_) {
+        for (auto* output : node->outputs()) {
+            state_.uses.erase(output);
+        }
+        state_.erased.push_back(node->id());
+        state_.touched.erase(node->id());
+    }
+    // nodes added and erased within one run never existed for the caller
+    state_.added.erase(std::remove_if(state_.added.begin(), state_.added.end(),
+        [this](ir::Node* node) { return erased_.count(node) > 0; }), state_.added.end());
+    graph_->removeNodes(erased_);
+    erased_.clear();
+}
+
+void RewriteRuleSet::add(RewriteRule rule) {
+    rules_.push_back(std::move(rule));
+    const RewriteRule* added = &rules_.back();
+    
+    auto by_benefit = [](const RewriteRule* a, const RewriteRule* b) {
+        return a->benefit > b->benefit;
+    };
+    
+    if (added->pattern.isWildcard()) {
+        wildcard_roots_.push_back(added);
+        for (auto& entry : by_root_) {
+            entry.second.push_back(added);
+            std::stable_sort(entry.second.begin(), entry.second.end(), by_benefit);
+        }
+        return;
+    }
+    
+    auto key = static_cast<int>(added->pattern.type());
+    auto it = by_root_.find(key);
+    if (it == by_root_.end()) {
+        it = by_root_.emplace(key, wildcard_roots_).first;
+    }
+    it->second.push_back(added);
+    std::stable_sort(it->second.begin(), it->second.end(), by_benefit);
+}
+
+const std::vector<const RewriteRule*>& RewriteRuleSet::candidates(ir::OpType type) const {
+    auto it = by_root_.find(static_cast<int>(type));
+    if (it != by_root_.end()) return it->second;
+    return wildcard_roots_;
+}
+
+int PatternRewriteDriver::run(ir::Graph* graph) {
+    return run(graph, graph->getNodesInTopoOrder());
+}
+
+int PatternRewriteDriver::run(ir::Graph* graph, const std::vector<ir::Node*>& seeds) {
+    if (rules_.empty()) return 0;
+    
+    Worklist worklist;
+    Rewriter rewriter(graph, worklist);
+    return drain(graph, seeds, worklist, rewriter);
+}
+
+int PatternRewriteDriver::run(ir::Graph* graph, const std::vector<ir::Node*>& seeds,
+                              RegionState& state) {
+    if (rules_.empty()) return 0;
+    
+    Worklist worklist;
+    Rewriter rewriter(graph, worklist, state);
+    return drain(graph, seeds, worklist, rewriter);
+}
+
+int PatternRewriteDriver::drain(ir::Graph* graph, const std::vector<ir::Node*>& seeds,
+                                Worklist& worklist, Rewriter& rewriter) {
+    for (auto* node : seeds) {
+        worklist.push(node->id());
+    }
+    
+    int rewrites = 0;
+    while (!worklist.empty()) {
+        auto* node = graph->getNode(worklist.pop());
+        if (!node || rewriter.isErased(node)) continue;
+        
+        for (const auto* rule : rules_.candidates(node->type())) {
+            Match m;
+            m.root = node;
+            if (!rule->pattern.match(node, rewriter.uses(), m)) continue;
+            if (!rule->rewrite(rewriter, m)) continue;
+            
+            rewrites++;
+            break; // node may be gone; anything that changed was requeued
+        }
+    }
+    
+    rewriter.commit();
+    return rewrites;
+}
+
+}
+}
@@ -0,0 +1,197 @@
+#include "optimizer/optimizer.h"
+#include "ir/autodiff.h"
+#include "codegen/codegen.h"
+#include <algorithm>
+#include <iostream>
+
+namespace dlcompiler {
+namespace optimizer {
+
+namespace {
+
+// activation lifetimes over program order, same accounting as the codegen
+// liveness annotation: live from the producer to the last compute reading it,
+// graph outputs never freed
+struct Liveness {
+    int64_t peak = 0;
+    size_t peak_pos = 0;
+    int64_t area = 0; // live bytes summed over program positions
+    std::unordered_map<const ir::Value*, std::pair<size_t, size_t>> interval; // def, last use
+};
+
+Liveness analyze(ir::Graph* graph) {
+    auto order = graph->getNodesInTopoOrder();
+    Liveness result;
+    
+    for (size_t pos = 0; pos < order.size(); ++pos) {
+        auto* node = order[pos];
+        bool compute = codegen::CodeGenerator::isComputeNode(node);
+        for (auto* input : node->inputs()) {
+            auto it = result.interval.find(input->storage());
+            if (it == result.interval.end()) continue;
+            if (node->type() == ir::OpType::OUTPUT) it->second.second = order.size();
+            else if (compute) it->second.second = std::max(it->second.second, pos);
+        }
+        if (!compute) continue;
+        for (auto* output : node->outputs()) {
+            result.interval[output] = {pos, pos};
+        }
+    }
+    
+    std::vector<int64_t> alloc(order.size() + 1, 0);
+    std::vector<int64_t> freed(order.size() + 1, 0);
+    for (const auto& entry : result.interval) {
+        alloc[entry.second.first] += entry.first->bytes();
+        freed[entry.second.second] += entry.first->bytes();
+    }
+    
+    int64_t live = 0;
+    for (size_t pos = 0; pos < order.size(); ++pos) {
+        live += alloc[pos];
+        result.area += live;
+        if (live > result.peak) {
+            result.peak = live;
+            result.peak_pos = pos;
+        }
+        live -= freed[pos];
+    }
+    return result;
+}
+
+bool hasBackwardReader(ir::Graph* graph, const ir::Value* value) {
+    for (auto* user : graph->getUsers(value)) {
+        if (ir::isBackwardNode(user)) return true;
+        if (user->type() == ir::OpType::RESHAPE && hasBackwardReader(graph, user->outputs()[0])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+bool RematerializationPass::run(ir::Graph* graph) {
+    codegen::CodeGenerator codegen;
+    recomputed_.clear();
+    extra_flops_ = 0;
+    num_recomputed_ = 0;
+    
+    auto live = analyze(graph);
+    int64_t initial = live.peak;
+    
+    while (live.peak > budget_bytes_) {
+        // forward activations held across the peak only because backward reads them
+        std::vector<std::pair<double, ir::Value*>> candidates;
+        for (const auto& entry : live.interval) {
+            auto* value = const_cast<ir::Value*>(entry.first);
+            auto* producer = value->producer();
+            if (ir::isBackwardNode(producer) || recomputed_.count(value)) continue;
+            if (entry.second.first >= live.peak_pos || entry.second.second < live.peak_pos) continue;
+            if (!hasBackwardReader(graph, value)) continue;
+            
+            // one level deep: recompute only from kept values, and keep the
+            // values other recomputations start from
+            bool chained = false;
+            for (auto* input : producer->inputs()) {
+                chained |= recomputed_.count(input->storage()) > 0;
+            }
+            for (auto* user : graph->getUsers(value)) {
+                chained |= user->getAttr("recompute") != 0;
+            }
+            if (chained) continue;
+            
+            double flops = std::max<int64_t>(codegen.computeFLOPs(producer), 1);
+            candidates.push_back({value->bytes() / flops, value});
+        }
+        std::sort(candidates.begin(), candidates.end(), 
+                  [](const std::pair<double, ir::Value*>& a, const std::pair<double, ir::Value*>& b) {
+                      if (a.first != b.first) return a.first > b.first;
+                      return a.second->id() < b.second->id();
+                  });
+        
+        bool accepted = false;
+        for (const auto& candidate : candidates) {
+            Edit edit;
+            evict(graph, candidate.second, edit);
+            // an eviction that only shrinks lifetimes elsewhere can still let a
+            // later one through, so equal peaks count if less memory is held overall
+            auto next = analyze(graph);
+            if (next.peak < live.peak || (next.peak == live.peak && next.area < live.area)) {
+                for (auto* node : edit.created) extra_flops_ += codegen.computeFLOPs(node);
+                num_recomputed_++;
+                live = std::move(next);
+                accepted = true;
+                break;
+            }
+            undo(graph, edit);
+        }
+        if (!accepted) break; // nothing left that lowers the peak
+    }
+    
+    peak_bytes_ = live.peak;
+    std::cout << "  Peak activations " << initial << " -> " << peak_bytes_ << " bytes (budget "
+              << budget_bytes_ << "), recomputing " << num_recomputed_ << " values for +"
+              << extra_flops_ << " FLOPs\n";
+    return num_recomputed_ > 0;
+}
+
+void RematerializationPass::evict(ir::Graph* graph, ir::Value* value, Edit& edit) {
+    auto* producer = value->producer();
+    
+    // recompute from whatever copies of its inputs already exist
+    std::vector<ir::Value*> inputs;
+    for (auto* input : producer->inputs()) {
+        auto it = recomputed_.find(input);
+        inputs.push_back(it != recomputed_.end() ? it->second : input);
+    }
+    
+    auto* copy = graph->cloneNode(producer, inputs);
+    copy->setAttr("backward", 1);
+    copy->setAttr("recompute", 1);
+    edit.created.insert(copy);
+    
+    for (size_t i = 0; i < producer->outputs().size(); ++i) {
+        if (producer->outputs()[i] == value) rewire(graph, value, copy->outputs()[i], edit);
+    }
+}
+
+void RematerializationPass::rewire(ir::Graph* graph, ir::Value* from, ir::Value* to, Edit& edit) {
+    recomputed_[from] = to;
+    edit.mapped.push_back(from);
+    
+    for (auto* user : graph->getUsers(from)) {
+        if (ir::isBackwardNode(user)) {
+            for (size_t i = 0; i < user->inputs().size(); ++i) {
+                if (user->inputs()[i] != from) continue;
+                edit.rewired.emplace_back(user, i, from);
+                user->setInput(i, to);
+            }
+        } else if (user->type() == ir::OpType::RESHAPE && 
+                   hasBackwardReader(graph, user->outputs()[0])) {
+            // backward reads a view of the value: recreate the view too
+            auto* view = graph->cloneNode(user, {to});
+            view->setAttr("backward", 1);
+            view->setAttr("recompute", 1);
+            edit.created.insert(view);
+            rewire(graph, user->outputs()[0], view->outputs()[0], edit);
+        }
+    }
+}
+
+void RematerializationPass::undo(ir::Graph* graph, const Edit& edit) {
+    for (auto it = edit.rewired.rbegin(); it != edit.rewired.rend(); ++it) {
+        std::get<0>(*it)->setInput(std::get<1>(*it), std::get<2>(*it));
+    }
+    std::unordered_set<ir::Value*> outputs;
+    for (auto* node : edit.created) {
+        outputs.insert(node->outputs().begin(), node->outputs().end());
+    }
+    graph->removeNodes(edit.created);
+    graph->removeValues(outputs);
+    for (const auto* value : edit.mapped) {
+        recomputed_.erase(value);
+    }
+}
+
+}
+}
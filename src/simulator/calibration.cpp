@@ -0,0 +1,598 @@
+#include "simulator/calibration.h"
+#include "simulator/simulator.h"
+#include "codegen/codegen.h"
+#include "ir/graph.h"
+#include "support/quiet_stdout.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DLC_X86_SIMD 1 // AVX2/FMA3 aren't in the x86-64 baseline, built per function and picked at runtime
+#include <immintrin.h>
+#endif
+
+namespace dlcompiler {
+namespace simulator {
+
+namespace {
+
+// each timed trial runs at least this long
+constexpr double kMinTrialSeconds = 0.02;
+constexpr int kTrials = 3;
+
+// working sets swept for cache knees, and the far set standing in for DRAM
+constexpr int64_t kMinSweepBytes = 16 * 1024;
+constexpr int64_t kMaxSweepBytes = 32 * 1024 * 1024;
+constexpr int64_t kFarBytes = 64 * 1024 * 1024;
+constexpr int64_t kLineBytes = 64;
+
+// a level ends where doubling the working set keeps less than this share
+// of the bandwidth
+constexpr double kKneeDrop = 0.7;
+
+constexpr int kFitRounds = 4;
+
+// keep the optimizer from dropping or hoisting benchmark loops
+void clobberMemory() {
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ __volatile__("" : : : "memory");
+#endif
+}
+
+template <typename T>
+void keep(T value) {
+    volatile T sink = value;
+    (void)sink;
+}
+
+// best per-call time over a few trials, each repeating f long enough to time
+template <typename F>
+double timeSeconds(F&& f) {
+    using clock = std::chrono::steady_clock;
+    double best = std::numeric_limits<double>::max();
+    int64_t reps = 1;
+    for (int trial = 0; trial < kTrials;) {
+        auto start = clock::now();
+        for (int64_t r = 0; r < reps; ++r) {
+            f();
+            clobberMemory();
+        }
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if (seconds < kMinTrialSeconds) {
+            reps *= 2;
+            continue;
+        }
+        best = std::min(best, seconds / reps);
+        trial++;
+    }
+    return best;
+}
+
+// C independent multiply-add chains W lanes wide, returning their sum;
+// fused wherever the baseline ISA makes std::fma an instruction rather
+// than a libm call
+template <int W, int C>
+float mulAddChains(int64_t iters) {
+    float acc[C][W];
+    for (int c = 0; c < C; ++c) {
+        for (int l = 0; l < W; ++l) acc[c][l] = 1.0f + 1e-3f * (c * W + l);
+    }
+    for (int64_t it = 0; it < iters; ++it) {
+        for (int c = 0; c < C; ++c) {
+            for (int l = 0; l < W; ++l) {
+#ifdef FP_FAST_FMAF
+                acc[c][l] = std::fma(acc[c][l], 0.999999f, 1e-6f);
+#else
+                acc[c][l] = acc[c][l] * 0.999999f + 1e-6f;
+#endif
+            }
+        }
+    }
+    
+    float sum = 0;
+    for (int c = 0; c < C; ++c) {
+        for (int l = 0; l < W; ++l) sum += acc[c][l];
+    }
+    return sum;
+}
+
+#ifdef DLC_X86_SIMD
+// the same chains as FMA3 instructions, 8 lanes per ymm register; chains
+// seeded in registers stay there, so the loop keeps them interleaved
+template <int W, int C>
+__attribute__((target("avx2,fma"))) float fmaChains(int64_t iters) {
+    if constexpr (W >= 8) {
+        constexpr int R = W / 8;
+        const __m256 scale = _mm256_set1_ps(0.999999f);
+        const __m256 bias = _mm256_set1_ps(1e-6f);
+        __m256 v[C * R];
+        for (int i = 0; i < C * R; ++i) v[i] = _mm256_set1_ps(1.0f + 1e-3f * i);
+        for (int64_t it = 0; it < iters; ++it) {
+            for (int i = 0; i < C * R; ++i) v[i] = _mm256_fmadd_ps(v[i], scale, bias);
+        }
+        __m256 sum = v[0];
+        for (int i = 1; i < C * R; ++i) sum = _mm256_add_ps(sum, v[i]);
+        return _mm256_cvtss_f32(sum);
+    } else if constexpr (W == 4) {
+        const __m128 scale = _mm_set1_ps(0.999999f);
+        const __m128 bias = _mm_set1_ps(1e-6f);
+        __m128 v[C];
+        for (int c = 0; c < C; ++c) v[c] = _mm_set1_ps(1.0f + 1e-3f * c);
+        for (int64_t it = 0; it < iters; ++it) {
+            for (int c = 0; c < C; ++c) v[c] = _mm_fmadd_ps(v[c], scale, bias);
+        }
+        __m128 sum = v[0];
+        for (int c = 1; c < C; ++c) sum = _mm_add_ps(sum, v[c]);
+        return _mm_cvtss_f32(sum);
+    } else {
+        static_assert(W == 1, "fma widths are 1, 4 or a multiple of 8");
+        float v[C];
+        for (int c = 0; c < C; ++c) v[c] = 1.0f + 1e-3f * c;
+        for (int64_t it = 0; it < iters; ++it) {
+            for (int c = 0; c < C; ++c) v[c] = std::fma(v[c], 0.999999f, 1e-6f);
+        }
+        float sum = 0;
+        for (int c = 0; c < C; ++c) sum += v[c];
+        return sum;
+    }
+}
+#endif
+
+#ifdef DLC_X86_SIMD
+// sum of words[0, n), n a multiple of 64: eight 32-byte loads in flight per
+// iteration so the load ports, not the adds, set the pace
+__attribute__((target("avx2"))) uint32_t sumAvx2(const uint32_t* words, int64_t n) {
+    constexpr int kAcc = 8;
+    __m256i acc[kAcc];
+    for (int u = 0; u < kAcc; ++u) acc[u] = _mm256_setzero_si256();
+    for (int64_t i = 0; i < n; i += 8 * kAcc) {
+        for (int u = 0; u < kAcc; ++u) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i + 8 * u));
+            acc[u] = _mm256_add_epi32(acc[u], v);
+        }
+    }
+    for (int u = 1; u < kAcc; ++u) acc[0] = _mm256_add_epi32(acc[0], acc[u]);
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc[0]);
+    return std::accumulate(lanes, lanes + 8, 0u);
+}
+#endif
+
+bool hostHasAvx2() {
+#ifdef DLC_X86_SIMD
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool hostHasFma() {
+#ifdef DLC_X86_SIMD
+    return hostHasAvx2() && __builtin_cpu_supports("fma");
+#elif defined(FP_FAST_FMAF)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// multiply-add throughput W lanes wide, with enough chains to cover
+// latency without spilling the register file
+template <int W>
+double simdFlopsPerSecond() {
+    constexpr int kChains = std::max(2, std::min(8, 64 / W));
+    constexpr int64_t kIters = 1 << 16;
+    
+    bool fused = hostHasFma();
+    float sum = 0;
+    double seconds = timeSeconds([&] {
+#ifdef DLC_X86_SIMD
+        if (fused) {
+            sum += fmaChains<W, kChains>(kIters);
+            return;
+        }
+#endif
+        sum += mulAddChains<W, kChains>(kIters);
+    });
+    (void)fused;
+    keep(sum);
+    return 2.0 * kChains * W * kIters / seconds;
+}
+
+// read bandwidth with the first `bytes` of buf as the working set; several
+// vector accumulators so the adds never limit the loads, and the widest
+// loads the host has so L1 isn't capped at the baseline's 16 bytes
+double readBandwidth(const std::vector<uint32_t>& buf, int64_t bytes) {
+    constexpr int64_t kLanes = 64;
+    int64_t words = bytes / sizeof(uint32_t) / kLanes * kLanes;
+    bool avx2 = hostHasAvx2();
+    uint32_t total = 0;
+    double seconds = timeSeconds([&] {
+        clobberMemory();
+#ifdef DLC_X86_SIMD
+        if (avx2) {
+            total += sumAvx2(buf.data(), words);
+            return;
+        }
+#endif
+        uint32_t sum[kLanes] = {};
+        for (int64_t i = 0; i < words; i += kLanes) {
+            for (int64_t l = 0; l < kLanes; ++l) sum[l] += buf[i + l];
+        }
+        for (int64_t l = 0; l < kLanes; ++l) total += sum[l];
+    });
+    (void)avx2;
+    keep(total);
+    return bytes / seconds;
+}
+
+using Sweep = std::vector<std::pair<int64_t, double>>;
+
+// last point, from `from` on, before bandwidth falls by more than kKneeDrop
+// in one doubling; sweep.size() when it never does
+size_t findKnee(const Sweep& sweep, size_t from) {
+    for (size_t i = from; i + 1 < sweep.size(); ++i) {
+        if (sweep[i + 1].second < kKneeDrop * sweep[i].second) return i;
+    }
+    return sweep.size();
+}
+
+// dependent loads around a random cycle of cache lines, ns per load
+double chaseLatencyNs(int64_t bytes) {
+    constexpr int64_t kStride = kLineBytes / sizeof(uint32_t);
+    constexpr int64_t kSteps = 1 << 18;
+    int64_t lines = std::max<int64_t>(bytes / kLineBytes, 2);
+    
+    std::vector<uint32_t> order(lines);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin() + 1, order.end(), std::mt19937(42));
+    std::vector<uint32_t> next(lines * kStride, 0);
+    for (int64_t i = 0; i < lines; ++i) {
+        next[order[i] * kStride] = order[(i + 1) % lines] * kStride;
+    }
+    
+    uint32_t p = 0;
+    double seconds = timeSeconds([&] {
+        for (int64_t s = 0; s < kSteps; ++s) p = next[p];
+    });
+    keep(p);
+    return seconds / kSteps * 1e9;
+}
+
+// kernels measured on the host and predicted by the simulator
+struct KernelShape {
+    bool conv;
+    int64_t a, b, c; // gemm: M, K, N; conv: C_in, H = W, C_out
+    int64_t kernel; // conv window, stride 1, same padding
+    bool fit; // used to fit the efficiency factor
+    
+    std::string name() const {
+        std::stringstream ss;
+        if (conv) {
+            ss << "conv " << a << "x" << b << "x" << b << " -> " << c << " "
+               << kernel << "x" << kernel;
+        } else {
+            ss << "gemm " << a << "x" << b << "x" << c;
+        }
+        return ss.str();
+    }
+};
+
+const std::vector<KernelShape>& kernelShapes() {
+    static const std::vector<KernelShape> shapes = {
+        {false, 256, 256, 256, 0, true},
+        {false, 512, 512, 512, 0, true},
+        {false, 384, 384, 384, 0, false},
+        {false, 128, 1024, 256, 0, false},
+        {false, 1024, 256, 64, 0, false},
+        {false, 1, 1024, 1024, 0, false},
+        {true, 16, 56, 32, 3, true},
+        {true, 32, 28, 64, 3, true},
+        {true, 64, 14, 64, 3, false},
+        {true, 64, 28, 128, 1, false},
+        {true, 3, 112, 16, 5, false},
+        {true, 128, 14, 128, 3, false},
+    };
+    return shapes;
+}
+
+// C = A B, i-k-j order so the inner loop vectorizes over N
+void hostGemm(const float* a, const float* b, float* c, int64_t m, int64_t k, int64_t n) {
+    std::fill(c, c + m * n, 0.0f);
+    for (int64_t i = 0; i < m; ++i) {
+        float* crow = c + i * n;
+        for (int64_t p = 0; p < k; ++p) {
+            float av = a[i * k + p];
+            const float* brow = b + p * n;
+            for (int64_t j = 0; j < n; ++j) crow[j] += av * brow[j];
+        }
+    }
+}
+
+// direct NCHW conv, batch 1, vectorizing over output columns
+void hostConv(const float* in, const float* w, float* out, int64_t c_in, int64_t hw,
+              int64_t c_out, int64_t kernel) {
+    int64_t pad = kernel / 2;
+    std::fill(out, out + c_out * hw * hw, 0.0f);
+    for (int64_t co = 0; co < c_out; ++co) {
+        float* plane = out + co * hw * hw;
+        for (int64_t ci = 0; ci < c_in; ++ci) {
+            const float* src = in + ci * hw * hw;
+            for (int64_t kh = 0; kh < kernel; ++kh) {
+                for (int64_t kw = 0; kw < kernel; ++kw) {
+                    float wv = w[((co * c_in + ci) * kernel + kh) * kernel + kw];
+                    int64_t lo = std::max<int64_t>(0, pad - kw);
+                    int64_t hi = std::min(hw, hw + pad - kw);
+                    for (int64_t oh = 0; oh < hw; ++oh) {
+                        int64_t ih = oh + kh - pad;
+                        if (ih < 0 || ih >= hw) continue;
+                        const float* row = src + ih * hw + kw - pad;
+                        float* dst = plane + oh * hw;
+                        for (int64_t ow = lo; ow < hi; ++ow) dst[ow] += wv * row[ow];
+                    }
+                }
+            }
+        }
+    }
+}
+
+double measureMs(const KernelShape& shape) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto random = [&](int64_t n) {
+        std::vector<float> v(n);
+        for (auto& x : v) x = dist(rng);
+        return v;
+    };
+    
+    double seconds;
+    if (shape.conv) {
+        auto in = random(shape.a * shape.b * shape.b);
+        auto w = random(shape.c * shape.a * shape.kernel * shape.kernel);
+        std::vector<float> out(shape.c * shape.b * shape.b);
+        seconds = timeSeconds([&] {
+            hostConv(in.data(), w.data(), out.data(), shape.a, shape.b, shape.c, shape.kernel);
+        });
+        keep(out[0]);
+    } else {
+        auto a = random(shape.a * shape.b);
+        auto b = random(shape.b * shape.c);
+        std::vector<float> c(shape.a * shape.c);
+        seconds = timeSeconds([&] {
+            hostGemm(a.data(), b.data(), c.data(), shape.a, shape.b, shape.c);
+        });
+        keep(c[0]);
+    }
+    return seconds * 1e3;
+}
+
+double predictMs(const ChipConfig& config, const KernelShape& shape) {
+    auto graph = ir::Graph::create();
+    if (shape.conv) {
+        auto x = graph->addInput({1, shape.a, shape.b, shape.b});
+        graph->addOutput(graph->addConv2D(x, shape.c, shape.kernel, 1, shape.kernel / 2));
+    } else {
+        auto x = graph->addInput({shape.a, shape.b});
+        graph->addOutput(graph->addMatMul(x, graph->addConstant({shape.b, shape.c})));
+    }
+    
+    QuietStdout quiet;
+    codegen::CodeGenerator codegen(config);
+    codegen.forceConvAlgorithm(codegen::ConvAlgorithm::DIRECT); // what hostConv runs
+    auto instructions = codegen.generate(graph.get());
+    
+    // steady state of back-to-back runs, like the timed host loop: weights
+    // are already resident from the previous run
+    Simulator sim(config);
+    sim.simulateSegment(instructions);
+    auto stats = sim.simulateSegment(instructions);
+    stats.cycles += sim.state().pending();
+    stats.finalize(config.clock_freq_ghz);
+    return stats.execution_time_ms;
+}
+
+}
+
+double CalibrationResult::heldOutError() const {
+    double sum = 0;
+    int count = 0;
+    for (const auto& entry : accuracy) {
+        if (entry.fitted) continue;
+        sum += std::abs(entry.error());
+        count++;
+    }
+    return count > 0 ? sum / count : 0;
+}
+
+void CalibrationResult::print() const {
+    std::cout << "\n ----> Host Microbenchmarks <----\n";
+    for (const auto& m : measurements) {
+        std::cout << "  " << std::left << std::setw(32) << m.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << m.value << " " << m.unit << "\n";
+    }
+    
+    std::cout << "\n ----> Calibrated Config <----\n" << config.toString() << "\n";
+    
+    std::cout << "\n ----> Predicted vs Measured <----\n";
+    for (const auto& entry : accuracy) {
+        std::cout << "  " << std::left << std::setw(30) << entry.kernel << std::setw(8)
+                  << (entry.fitted ? "(fit)" : "") << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(9) << entry.measured_ms << " ms  "
+                  << std::setw(9) << entry.predicted_ms << " ms  " << std::showpos
+                  << std::setprecision(1) << std::setw(7) << 100 * entry.error()
+                  << std::noshowpos << "%\n";
+    }
+    std::cout << "Mean |error| on held-out shapes: " << std::setprecision(1)
+              << 100 * heldOutError() << "%\n";
+}
+
+CalibrationResult Calibrator::run() {
+    std::cout << "\n ----> Calibrating against host <----\n";
+    result_ = CalibrationResult();
+    
+    // one core: the microbenchmarks and reference kernels are single-threaded
+    result_.config.compute_units = 1;
+    measureClock();
+    measureCompute();
+    measureMemory();
+    fitKernelEfficiency();
+    return result_;
+}
+
+void Calibrator::measureClock() {
+    // a dependent integer add chain retires one add per cycle; unrolled so
+    // loop overhead never sets the pace, and register operands since some
+    // cores fold add-immediate chains at rename
+    constexpr int64_t kAdds = 1 << 24;
+    constexpr int kUnroll = 8;
+    uint64_t x = 0;
+    uint64_t step = 1;
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ __volatile__("" : "+r"(step));
+#endif
+    auto chain = [&] {
+        for (int64_t i = 0; i < kAdds / kUnroll; ++i) {
+            for (int u = 0; u < kUnroll; ++u) {
+                x += step;
+#if defined(__GNUC__) || defined(__clang__)
+                __asm__ __volatile__("" : "+r"(x));
+#endif
+            }
+        }
+    };
+    chain(); // let the core leave any low-power state first
+    double seconds = timeSeconds(chain);
+    keep(x);
+    
+    result_.config.clock_freq_ghz = kAdds / seconds / 1e9;
+    record("clock (add chain)", result_.config.clock_freq_ghz, "GHz");
+}
+
+void Calibrator::measureCompute() {
+    std::vector<std::pair<int, double>> rates = {
+        {1, simdFlopsPerSecond<1>()}, {4, simdFlopsPerSecond<4>()},
+        {8, simdFlopsPerSecond<8>()}, {16, simdFlopsPerSecond<16>()}
+    };
+    
+    record("fused multiply-add", hostHasFma() ? 1 : 0, "available");
+    double peak = 0;
+    for (const auto& rate : rates) {
+        record("fma throughput, width " + std::to_string(rate.first), rate.second / 1e9, "GFLOP/s");
+        peak = std::max(peak, rate.second);
+    }
+    
+    // the cost model peaks at 2 flops per lane per cycle, so the fitted
+    // width is the lanes the host actually sustains
+    double flops_per_cycle = peak / (result_.config.clock_freq_ghz * 1e9);
+    result_.config.simd_width = std::max(1, static_cast<int>(std::lround(flops_per_cycle / 2)));
+    record("peak flops per cycle", flops_per_cycle, "flop/cycle");
+}
+
+void Calibrator::measureMemory() {
+    auto& config = result_.config;
+    double ghz = config.clock_freq_ghz;
+    
+    // read bandwidth across working sets: the first knee bounds the
+    // scratchpad, the next one the L2; a level without a knee keeps its
+    // default size
+    std::vector<uint32_t> buf(kMaxSweepBytes / sizeof(uint32_t), 1);
+    Sweep sweep;
+    for (int64_t bytes = kMinSweepBytes; bytes <= kMaxSweepBytes; bytes *= 2) {
+        sweep.push_back({bytes, readBandwidth(buf, bytes)});
+        record("read bandwidth, " + std::to_string(bytes / 1024) + " KB",
+               sweep.back().second / 1e9, "GB/s");
+    }
+    
+    size_t l1_end = findKnee(sweep, 0);
+    size_t l2_end = sweep.size();
+    if (l1_end < sweep.size()) {
+        config.scratchpad_kb = static_cast<int>(sweep[l1_end].first / 1024);
+        record("scratchpad, bandwidth knee", config.scratchpad_kb, "KB");
+        l2_end = findKnee(sweep, l1_end + 1);
+    } else {
+        record("scratchpad, no knee (default)", config.scratchpad_kb, "KB");
+    }
+    
+    if (l2_end < sweep.size()) {
+        config.l2_size_kb = static_cast<int>(sweep[l2_end].first / 1024);
+        record("l2, bandwidth knee", config.l2_size_kb, "KB");
+        
+        // median over the plateau between the knees
+        std::vector<double> plateau;
+        for (size_t i = l1_end + 1; i <= l2_end; ++i) plateau.push_back(sweep[i].second);
+        std::nth_element(plateau.begin(), plateau.begin() + plateau.size() / 2, plateau.end());
+        config.l2_bandwidth_gb_s = plateau[plateau.size() / 2] / 1e9;
+        
+        // stationary weights live in the shared cache on a CPU
+        config.weight_buffer_kb = config.l2_size_kb / 2;
+    } else {
+        record("l2, no knee (default)", config.l2_size_kb, "KB");
+    }
+    
+    // streaming triad over sets far past the caches
+    int64_t n = kFarBytes / 2 / sizeof(float);
+    std::vector<float> a(n, 0.0f), b(n, 1.0f), c(n, 2.0f);
+    double seconds = timeSeconds([&] {
+        for (int64_t i = 0; i < n; ++i) a[i] = b[i] + 0.5f * c[i];
+    });
+    keep(a[n / 2]);
+    config.memory_bandwidth_gb_s = 3.0 * n * sizeof(float) / seconds / 1e9;
+    record("stream triad", config.memory_bandwidth_gb_s, "GB/s");
+    
+    // DRAM channels, banks and row timing aren't observable from user space
+    // and keep their defaults; L2 latency is chased halfway between the
+    // knees (log scale), past the scratchpad and well inside the L2
+    int64_t l2_probe = static_cast<int64_t>(
+        std::sqrt(static_cast<double>(config.scratchpad_kb) * config.l2_size_kb) * 1024);
+    double l2_ns = chaseLatencyNs(l2_probe);
+    double dram_ns = chaseLatencyNs(kFarBytes);
+    config.l2_latency_cycles = std::max(1, static_cast<int>(std::lround(l2_ns * ghz)));
+    config.dram_latency_cycles = std::max(1, static_cast<int>(std::lround(dram_ns * ghz)));
+    record("l2 load latency, " + std::to_string(l2_probe / 1024) + " KB", l2_ns, "ns");
+    record("dram load latency", dram_ns, "ns");
+}
+
+void Calibrator::fitKernelEfficiency() {
+    auto& config = result_.config;
+    const auto& shapes = kernelShapes();
+    
+    std::vector<double> measured;
+    for (const auto& shape : shapes) {
+        measured.push_back(measureMs(shape));
+    }
+    
+    // efficiency only scales the compute part of a prediction, so iterate:
+    // each round moves the factor by the geometric mean misprediction
+    for (int round = 0; round < kFitRounds; ++round) {
+        for (bool conv : {false, true}) {
+            double log_ratio = 0;
+            int count = 0;
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                if (!shapes[i].fit || shapes[i].conv != conv) continue;
+                log_ratio += std::log(predictMs(config, shapes[i]) / measured[i]);
+                count++;
+            }
+            double& efficiency = conv ? config.conv_efficiency : config.matmul_efficiency;
+            efficiency = std::min(4.0, std::max(0.01, efficiency * std::exp(log_ratio / count)));
+        }
+    }
+    
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        result_.accuracy.push_back({shapes[i].name(), measured[i], predictMs(config, shapes[i]),
+                                    shapes[i].fit});
+    }
+}
+
+void Calibrator::record(const std::string& name, double value, const std::string& unit) {
+    result_.measurements.push_back({name, value, unit});
+}
+
+}
+}
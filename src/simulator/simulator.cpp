@@ -1,92 +1,473 @@
 #include "simulator/simulator.h"
+#include <fstream>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
 #include <algorithm>
 
 namespace dlcompiler {
 namespace simulator {
 
+namespace {
+
+// L2 residency is tracked per block of a tensor
+constexpr int64_t kL2BlockBytes = 64 * 1024;
+constexpr int64_t kL2BlockSpan = int64_t(1) << 24; // blocks per tensor key
+constexpr int64_t kDramBurstBytes = 64;
+
+int64_t l2Key(int64_t tensor, int64_t block) {
+    return tensor * kL2BlockSpan + block;
+}
+
+// every ChipConfig field by name, for config files
+template <typename Config, typename Visit>
+void forEachField(Config& config, Visit visit) {
+    visit("compute_units", config.compute_units);
+    visit("memory_bandwidth_gb_s", config.memory_bandwidth_gb_s);
+    visit("scratchpad_kb", config.scratchpad_kb);
+    visit("simd_width", config.simd_width);
+    visit("clock_freq_ghz", config.clock_freq_ghz);
+    visit("weight_buffer_kb", config.weight_buffer_kb);
+    visit("sparse_n", config.sparse_n);
+    visit("sparse_m", config.sparse_m);
+    visit("sparse_gather_efficiency", config.sparse_gather_efficiency);
+    visit("l2_size_kb", config.l2_size_kb);
+    visit("l2_bandwidth_gb_s", config.l2_bandwidth_gb_s);
+    visit("l2_latency_cycles", config.l2_latency_cycles);
+    visit("dram_channels", config.dram_channels);
+    visit("dram_banks", config.dram_banks);
+    visit("dram_row_bytes", config.dram_row_bytes);
+    visit("dram_latency_cycles", config.dram_latency_cycles);
+    visit("dram_row_miss_cycles", config.dram_row_miss_cycles);
+    visit("matmul_efficiency", config.matmul_efficiency);
+    visit("conv_efficiency", config.conv_efficiency);
+}
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+}
+
 std::string ChipConfig::toString() const {
     std::stringstream ss;
     ss << "ChipConfig{\n";
     ss << "  compute_units: " << compute_units << "\n";
     ss << "  memory_bandwidth: " << memory_bandwidth_gb_s << " GB/s\n";
-    ss << "  cache_size: " << cache_size_kb << " KB\n";
+    ss << "  scratchpad: " << scratchpad_kb << " KB x " << compute_units << "\n";
     ss << "  simd_width: " << simd_width << "\n";
     ss << "  clock_freq: " << clock_freq_ghz << " GHz\n";
+    ss << "  weight_buffer: " << weight_buffer_kb << " KB\n";
+    if (sparse_m > 0) {
+        ss << "  sparse_datapath: " << sparse_n << ":" << sparse_m << "\n";
+    }
+    ss << "  sparse_gather_efficiency: " << sparse_gather_efficiency << "\n";
+    ss << "  l2: " << l2_size_kb << " KB, " << l2_bandwidth_gb_s << " GB/s\n";
+    ss << "  dram: " << dram_channels << " channels x " << dram_banks << " banks, " 
+       << dram_row_bytes << " B rows\n";
+    if (matmul_efficiency != 1.0 || conv_efficiency != 1.0) {
+        ss << "  kernel_efficiency: matmul " << matmul_efficiency << ", conv " 
+           << conv_efficiency << "\n";
+    }
     ss << "}";
     return ss.str();
 }
 
+void ChipConfig::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("cannot write chip config: " + path);
+    }
+    out << std::setprecision(6);
+    forEachField(*this, [&](const char* key, const auto& value) {
+        out << key << " = " << value << "\n";
+    });
+}
+
+ChipConfig ChipConfig::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("cannot read chip config: " + path);
+    }
+    
+    // fields missing from the file keep their defaults
+    ChipConfig config;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error(path + ":" + std::to_string(line_no) + ": expected key = value");
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::stringstream value(trim(line.substr(eq + 1)));
+        
+        bool known = false;
+        forEachField(config, [&](const char* name, auto& field) {
+            if (key != name) return;
+            known = true;
+            if (!(value >> field)) {
+                throw std::runtime_error(path + ":" + std::to_string(line_no) + 
+                                         ": bad value for " + key);
+            }
+        });
+        if (!known) {
+            throw std::runtime_error(path + ":" + std::to_string(line_no) + 
+                                     ": unknown chip config key " + key);
+        }
+    }
+    return config;
+}
+
+ExecutionStats& ExecutionStats::operator+=(const ExecutionStats& other) {
+    cycles += other.cycles;
+    memory_accesses += other.memory_accesses;
+    cache_hits += other.cache_hits;
+    cache_misses += other.cache_misses;
+    compute_cycles += other.compute_cycles;
+    memory_cycles += other.memory_cycles;
+    weight_bytes_loaded += other.weight_bytes_loaded;
+    weight_bytes_reused += other.weight_bytes_reused;
+    weight_reuse_hits += other.weight_reuse_hits;
+    weight_buffer_spills += other.weight_buffer_spills;
+    prefetch_hidden_cycles += other.prefetch_hidden_cycles;
+    kernel_launches += other.kernel_launches;
+    activation_bytes_loaded += other.activation_bytes_loaded;
+    memory_traffic_bytes += other.memory_traffic_bytes;
+    peak_sram_bytes = std::max(peak_sram_bytes, other.peak_sram_bytes);
+    peak_working_set_bytes = std::max(peak_working_set_bytes, other.peak_working_set_bytes);
+    peak_activation_bytes = std::max(peak_activation_bytes, other.peak_activation_bytes);
+    for (const auto& entry : other.conv_algorithms) {
+        conv_algorithms[entry.first] += entry.second;
+    }
+    conv_cycles_saved += other.conv_cycles_saved;
+    for (const auto& entry : other.sparse_formats) {
+        sparse_formats[entry.first] += entry.second;
+    }
+    sparse_flops_skipped += other.sparse_flops_skipped;
+    sparse_index_bytes += other.sparse_index_bytes;
+    dma_transfers += other.dma_transfers;
+    scratchpad_bytes += other.scratchpad_bytes;
+    l2_bytes += other.l2_bytes;
+    l2_writeback_bytes += other.l2_writeback_bytes;
+    dram_bytes += other.dram_bytes;
+    dram_row_hits += other.dram_row_hits;
+    dram_row_misses += other.dram_row_misses;
+    dram_row_conflicts += other.dram_row_conflicts;
+    dma_hidden_cycles += other.dma_hidden_cycles;
+    l2_stall_cycles += other.l2_stall_cycles;
+    dram_stall_cycles += other.dram_stall_cycles;
+    contention_cycles += other.contention_cycles;
+    return *this;
+}
+
+ExecutionStats& ExecutionStats::operator-=(const ExecutionStats& other) {
+    cycles -= other.cycles;
+    memory_accesses -= other.memory_accesses;
+    cache_hits -= other.cache_hits;
+    cache_misses -= other.cache_misses;
+    compute_cycles -= other.compute_cycles;
+    memory_cycles -= other.memory_cycles;
+    weight_bytes_loaded -= other.weight_bytes_loaded;
+    weight_bytes_reused -= other.weight_bytes_reused;
+    weight_reuse_hits -= other.weight_reuse_hits;
+    weight_buffer_spills -= other.weight_buffer_spills;
+    prefetch_hidden_cycles -= other.prefetch_hidden_cycles;
+    kernel_launches -= other.kernel_launches;
+    activation_bytes_loaded -= other.activation_bytes_loaded;
+    memory_traffic_bytes -= other.memory_traffic_bytes;
+    for (const auto& entry : other.conv_algorithms) {
+        if ((conv_algorithms[entry.first] -= entry.second) == 0) conv_algorithms.erase(entry.first);
+    }
+    conv_cycles_saved -= other.conv_cycles_saved;
+    for (const auto& entry : other.sparse_formats) {
+        if ((sparse_formats[entry.first] -= entry.second) == 0) sparse_formats.erase(entry.first);
+    }
+    sparse_flops_skipped -= other.sparse_flops_skipped;
+    sparse_index_bytes -= other.sparse_index_bytes;
+    dma_transfers -= other.dma_transfers;
+    scratchpad_bytes -= other.scratchpad_bytes;
+    l2_bytes -= other.l2_bytes;
+    l2_writeback_bytes -= other.l2_writeback_bytes;
+    dram_bytes -= other.dram_bytes;
+    dram_row_hits -= other.dram_row_hits;
+    dram_row_misses -= other.dram_row_misses;
+    dram_row_conflicts -= other.dram_row_conflicts;
+    dma_hidden_cycles -= other.dma_hidden_cycles;
+    l2_stall_cycles -= other.l2_stall_cycles;
+    dram_stall_cycles -= other.dram_stall_cycles;
+    contention_cycles -= other.contention_cycles;
+    return *this;
+}
+
+void ExecutionStats::finalize(double clock_freq_ghz) {
+    // calc execution time
+    execution_time_ms = cycles / (clock_freq_ghz * 1e6);
+    
+    // calc utilization
+    int64_t total_cycles = compute_cycles + memory_cycles;
+    if (total_cycles > 0) {
+        compute_utilization = 100.0 * compute_cycles / total_cycles;
+        memory_bound_time = 100.0 * memory_cycles / total_cycles;
+    }
+}
+
 void ExecutionStats::print() const {
     std::cout << "\n=== Execution Statistics ===\n";
     std::cout << std::fixed << std::setprecision(2);
     std::cout << "Total cycles:          " << cycles << "\n";
     std::cout << "Execution time:        " << execution_time_ms << " ms\n";
     std::cout << "Memory accesses:       " << memory_accesses << "\n";
-    std::cout << "Cache hits:            " << cache_hits << " (" 
-              << (100.0 * cache_hits / std::max(1LL, cache_hits + cache_misses)) << "%)\n";
-    std::cout << "Cache misses:          " << cache_misses << " (" 
-              << (100.0 * cache_misses / std::max(1LL, cache_hits + cache_misses)) << "%)\n";
+    std::cout << "L2 hits:               " << cache_hits << " (" 
+              << (100.0 * cache_hits / std::max<int64_t>(1, cache_hits + cache_misses)) << "%)\n";
+    std::cout << "L2 misses:             " << cache_misses << " (" 
+              << (100.0 * cache_misses / std::max<int64_t>(1, cache_hits + cache_misses)) << "%)\n";
     std::cout << "Compute utilization:   " << compute_utilization << "%\n";
     std::cout << "Memory bound time:     " << memory_bound_time << "%\n";
+    std::cout << "Weight bytes loaded:   " << weight_bytes_loaded << "\n";
+    std::cout << "Weight bytes reused:   " << weight_bytes_reused << "\n";
+    std::cout << "Weight buffer hits:    " << weight_reuse_hits << "\n";
+    std::cout << "Weight buffer spills:  " << weight_buffer_spills << "\n";
+    std::cout << "Prefetch hidden:       " << prefetch_hidden_cycles << " cycles\n";
+    std::cout << "Kernel launches:       " << kernel_launches << "\n";
+    std::cout << "Activation loads:      " << activation_bytes_loaded << " bytes\n";
+    std::cout << "Memory traffic:        " << memory_traffic_bytes << " bytes\n";
+    std::cout << "Peak SRAM:             " << peak_sram_bytes << " bytes\n";
+    std::cout << "Peak working set:      " << peak_working_set_bytes << " bytes\n";
+    std::cout << "Peak activations:      " << peak_activation_bytes << " bytes\n";
+    std::cout << "DMA transfers:         " << dma_transfers << "\n";
+    std::cout << "Scratchpad traffic:    " << scratchpad_bytes << " bytes\n";
+    std::cout << "L2 traffic:            " << l2_bytes << " bytes (" 
+              << l2_writeback_bytes << " written back)\n";
+    std::cout << "DRAM traffic:          " << dram_bytes << " bytes\n";
+    std::cout << "DRAM row hits:         " 
+              << (100.0 * dram_row_hits / std::max<int64_t>(1, dram_row_hits + dram_row_misses)) 
+              << "% (" << dram_row_conflicts << " conflicts)\n";
+    std::cout << "Memory stalls:         L2 " << l2_stall_cycles << ", DRAM " << dram_stall_cycles 
+              << ", contention " << contention_cycles << " cycles\n";
+    std::cout << "DMA hidden:            " << dma_hidden_cycles << " cycles\n";
+    if (!conv_algorithms.empty()) {
+        std::cout << "Conv algorithms:      ";
+        for (const auto& entry : conv_algorithms) {
+            std::cout << " " << entry.first << " x" << entry.second;
+        }
+        std::cout << "\n";
+        std::cout << "Conv cycles saved:     " << conv_cycles_saved << " (est. vs direct)\n";
+    }
+    if (!sparse_formats.empty()) {
+        std::cout << "Sparse weights:       ";
+        for (const auto& entry : sparse_formats) {
+            std::cout << " " << entry.first << " x" << entry.second;
+        }
+        std::cout << "\n";
+        std::cout << "Sparse flops skipped:  " << sparse_flops_skipped << "\n";
+        std::cout << "Sparse index bytes:    " << sparse_index_bytes << "\n";
+    }
     std::cout << "-----------------------\n";
 }
 
-bool CacheModel::access(int64_t, int64_t size) {
-    // simple cache model: if data fits in cache, it's a hit
-
-    if (size <= size_bytes_) {
-        if (current_usage_ + size <= size_bytes_) {
-            current_usage_ += size;
-            hits_++;
-            return true;
-        }
+bool CacheModel::accessResident(int64_t key, int64_t size, bool write) {
+    auto it = resident_.find(key);
+    if (it != resident_.end()) {
+        it->second->dirty |= write;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        hits_++;
+        return true;
     }
     
-    // cache miss
     misses_++;
-    current_usage_ = std::min(current_usage_ + size, size_bytes_);
+    if (size > size_bytes_) {
+        return false;
+    }
+    
+    // evict least recently used until the new entry fits
+    while (current_usage_ + size > size_bytes_ && !lru_.empty()) {
+        if (lru_.back().dirty) writebacks_.push_back(lru_.back());
+        current_usage_ -= lru_.back().bytes;
+        resident_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+    lru_.push_front({key, size, write});
+    resident_[key] = lru_.begin();
+    current_usage_ += size;
     return false;
 }
 
+void CacheModel::invalidate(int64_t key) {
+    auto it = resident_.find(key);
+    if (it == resident_.end()) return;
+    current_usage_ -= it->second->bytes;
+    lru_.erase(it->second);
+    resident_.erase(it);
+}
+
+std::vector<CacheModel::Entry> CacheModel::takeWritebacks() {
+    std::vector<Entry> evicted;
+    evicted.swap(writebacks_);
+    return evicted;
+}
+
+CacheModel::Snapshot CacheModel::snapshot() const {
+    return {current_usage_, std::vector<Entry>(lru_.begin(), lru_.end())};
+}
+
+void CacheModel::restore(const Snapshot& snapshot) {
+    current_usage_ = snapshot.usage;
+    lru_.assign(snapshot.resident.begin(), snapshot.resident.end());
+    resident_.clear();
+    for (auto it = lru_.begin(); it != lru_.end(); ++it) {
+        resident_[it->key] = it;
+    }
+    writebacks_.clear();
+}
+
 void CacheModel::reset() {
     current_usage_ = 0;
     hits_ = 0;
     misses_ = 0;
+    lru_.clear();
+    resident_.clear();
+    writebacks_.clear();
 }
 
 ExecutionStats Simulator::execute(const std::vector<codegen::Instruction>& instructions) {
     std::cout << "\n ----> Simulating Execution <----\n";
     std::cout << config_.toString() << "\n\n";
     
-    ExecutionStats stats;
-    cache_.reset();
+    reset();
+    ExecutionStats stats = simulateSegment(instructions);
+    
+    // prefetches and write-backs with no compute left to hide behind
+    stats.cycles += drainQueue(stats);
     
-    int64_t compute_cycles = 0;
-    int64_t memory_cycles = 0;
+    stats.finalize(config_.clock_freq_ghz);
+    
+    std::cout << "Simulation complete\n";
+    stats.print();
+    
+    return stats;
+}
+
+void Simulator::reset() {
+    l2_.reset();
+    weight_buffer_.reset();
+    std::fill(open_rows_.begin(), open_rows_.end(), -1);
+    std::fill(row_owner_.begin(), row_owner_.end(), 0);
+    pending_prefetch_ = 0;
+    pending_l2_ = 0;
+    pending_dram_ = 0;
+    live_activations_ = 0;
+}
+
+Simulator::State Simulator::state() const {
+    return {l2_.snapshot(), weight_buffer_.snapshot(), open_rows_, row_owner_, 
+            pending_prefetch_, pending_l2_, pending_dram_, live_activations_};
+}
+
+void Simulator::restore(const State& state) {
+    l2_.restore(state.l2);
+    weight_buffer_.restore(state.weight_buffer);
+    open_rows_ = state.open_rows;
+    row_owner_ = state.row_owner;
+    pending_prefetch_ = state.pending_prefetch;
+    pending_l2_ = state.pending_l2;
+    pending_dram_ = state.pending_dram;
+    live_activations_ = state.live_activations;
+}
+
+ExecutionStats Simulator::simulateSegment(const std::vector<codegen::Instruction>& instructions) {
+    ExecutionStats stats;
+    int64_t hits_before = l2_.hits();
+    int64_t misses_before = l2_.misses();
+    int last_launch = -1; // tiled kernels issue several COMPUTEs per launch
     
     for (const auto& inst : instructions) {
         int64_t inst_cycles = 0;
         
         switch (inst.type) {
             case codegen::InstructionType::LOAD:
-                inst_cycles = simulateLoad(inst);
-                memory_cycles += inst_cycles;
+            case codegen::InstructionType::STORE:
+            case codegen::InstructionType::DMA: {
                 stats.memory_accesses++;
+                if (inst.is_weight) {
+                    inst_cycles = drainQueue(stats) + simulateWeightLoad(inst, stats);
+                    stats.memory_cycles += inst_cycles;
+                    break;
+                }
+                
+                auto moved = simulateDMA(inst, stats);
+                if (inst.async) {
+                    // double-buffered, paid for by the next compute
+                    pending_l2_ += moved.l2;
+                    pending_dram_ += moved.dram;
+                    break;
+                }
+                inst_cycles = drainQueue(stats) + moved.l2 + moved.dram;
+                stats.l2_stall_cycles += moved.l2;
+                stats.dram_stall_cycles += moved.dram;
+                stats.memory_cycles += moved.l2 + moved.dram;
                 break;
+            }
                 
-            case codegen::InstructionType::STORE:
-                inst_cycles = simulateStore(inst);
-                memory_cycles += inst_cycles;
+            case codegen::InstructionType::PREFETCH:
+                // issued async, paid for by the next compute
+                pending_prefetch_ += simulateWeightLoad(inst, stats);
                 stats.memory_accesses++;
                 break;
                 
-            case codegen::InstructionType::COMPUTE:
+            case codegen::InstructionType::COMPUTE: {
                 inst_cycles = simulateCompute(inst);
-                compute_cycles += inst_cycles;
+                stats.compute_cycles += inst_cycles;
+                if (inst.node_id != last_launch || inst.node_id < 0) stats.kernel_launches++;
+                last_launch = inst.node_id;
+                if (!inst.algorithm.empty()) {
+                    stats.conv_algorithms[inst.algorithm]++;
+                    stats.conv_cycles_saved += inst.cycles_saved;
+                }
+                if (!inst.sparse_format.empty()) {
+                    stats.sparse_formats[inst.sparse_format]++;
+                    stats.sparse_flops_skipped += inst.flops_skipped;
+                }
+                stats.peak_sram_bytes = std::max(stats.peak_sram_bytes, 
+                    inst.input_size + inst.output_size + inst.scratch_bytes);
+                stats.peak_working_set_bytes = std::max(stats.peak_working_set_bytes, 
+                                                        inst.working_set_bytes);
+                
+                live_activations_ += inst.alloc_bytes;
+                stats.peak_activation_bytes = std::max(stats.peak_activation_bytes, live_activations_);
+                live_activations_ -= inst.free_bytes;
+                
+                // queued prefetches and DMA overlap this compute, only the tail stalls
+                int64_t budget = inst_cycles;
+                int64_t prefetch_hidden = std::min(pending_prefetch_, budget);
+                budget -= prefetch_hidden;
+                int64_t dma = pending_l2_ + pending_dram_;
+                int64_t dma_hidden = std::min(dma, budget);
+                stats.prefetch_hidden_cycles += prefetch_hidden;
+                stats.dma_hidden_cycles += dma_hidden;
+                
+                int64_t exposed = pending_prefetch_ - prefetch_hidden + dma - dma_hidden;
+                if (dma > dma_hidden) {
+                    int64_t l2_exposed = (dma - dma_hidden) * pending_l2_ / dma;
+                    stats.l2_stall_cycles += l2_exposed;
+                    stats.dram_stall_cycles += dma - dma_hidden - l2_exposed;
+                }
+                stats.dram_stall_cycles += pending_prefetch_ - prefetch_hidden;
+                stats.memory_cycles += exposed;
+                inst_cycles += exposed;
+                pending_prefetch_ = 0;
+                pending_l2_ = 0;
+                pending_dram_ = 0;
                 break;
+            }
                 
             case codegen::InstructionType::SYNC:
                 inst_cycles = 10;
@@ -96,55 +477,183 @@ ExecutionStats Simulator::execute(const std::vector<codegen::Instruction>& instr
         stats.cycles += inst_cycles;
     }
     
-    // cache stats
-    stats.cache_hits = cache_.hits();
-    stats.cache_misses = cache_.misses();
+    // L2 stats
+    stats.cache_hits = l2_.hits() - hits_before;
+    stats.cache_misses = l2_.misses() - misses_before;
     
-    // calc execution time
-    stats.execution_time_ms = stats.cycles / (config_.clock_freq_ghz * 1e6);
+    return stats;
+}
+
+int64_t Simulator::drainQueue(ExecutionStats& stats) {
+    int64_t queued = pending_prefetch_ + pending_l2_ + pending_dram_;
+    stats.contention_cycles += queued;
+    stats.memory_cycles += queued;
+    pending_prefetch_ = 0;
+    pending_l2_ = 0;
+    pending_dram_ = 0;
+    return queued;
+}
+
+Simulator::Transfer Simulator::simulateDMA(const codegen::Instruction& inst, ExecutionStats& stats) {
+    // moves into a scratchpad come from src, moves out of one go to dst
+    bool inbound = inst.type == codegen::InstructionType::LOAD || 
+                   (inst.type == codegen::InstructionType::DMA && 
+                    inst.dst == codegen::MemoryLevel::SCRATCHPAD);
+    auto level = inbound ? inst.src : inst.dst;
+    int64_t bytes = inbound ? inst.input_size : inst.output_size;
     
-    // calc utilization
-    int64_t total_cycles = compute_cycles + memory_cycles;
-    if (total_cycles > 0) {
-        stats.compute_utilization = 100.0 * compute_cycles / total_cycles;
-        stats.memory_bound_time = 100.0 * memory_cycles / total_cycles;
+    stats.dma_transfers++;
+    stats.scratchpad_bytes += bytes;
+    stats.memory_traffic_bytes += bytes;
+    if (inbound) stats.activation_bytes_loaded += bytes;
+    
+    Transfer cycles;
+    if (bytes <= 0 || level == codegen::MemoryLevel::SCRATCHPAD) {
+        return cycles;
     }
     
-    std::cout << "Simulation complete\n";
-    stats.print();
+    // the move as runs of the tensor
+    int64_t run = inst.run_bytes > 0 ? std::min(inst.run_bytes, bytes) : bytes;
+    int64_t stride = inst.run_stride > 0 ? inst.run_stride : run;
+    int64_t runs = (bytes + run - 1) / run;
+    auto load = channelLoad();
     
-    return stats;
+    if (level == codegen::MemoryLevel::DRAM) {
+        for (int64_t r = 0; r < runs; ++r) {
+            walkDram(inst.value_id, inst.offset + r * stride, std::min(run, bytes - r * run), 
+                     load, stats);
+        }
+    } else {
+        // L2 residency in blocks; inbound misses read the missing part from
+        // DRAM, outbound writes allocate dirty blocks
+        stats.l2_bytes += bytes;
+        int64_t last_block = 0;
+        for (int64_t r = 0; r < runs; ++r) {
+            int64_t begin = inst.offset + r * stride;
+            int64_t end = begin + std::min(run, bytes - r * run);
+            for (int64_t block = begin / kL2BlockBytes; block * kL2BlockBytes < end; ++block) {
+                int64_t lo = std::max(begin, block * kL2BlockBytes);
+                int64_t hi = std::min(end, (block + 1) * kL2BlockBytes);
+                bool hit = l2_.accessResident(l2Key(inst.value_id, block), kL2BlockBytes, !inbound);
+                if (inbound && !hit) walkDram(inst.value_id, lo, hi - lo, load, stats);
+                last_block = std::max(last_block, block);
+            }
+        }
+        
+        // the last reader drops the tensor instead of writing it back later
+        if (inst.last_use) {
+            for (int64_t block = 0; block <= last_block; ++block) {
+                l2_.invalidate(l2Key(inst.value_id, block));
+            }
+        }
+        
+        for (const auto& evicted : l2_.takeWritebacks()) {
+            int64_t block = evicted.key & (kL2BlockSpan - 1);
+            walkDram((evicted.key - block) / kL2BlockSpan, block * kL2BlockBytes, evicted.bytes, 
+                     load, stats);
+            stats.l2_writeback_bytes += evicted.bytes;
+        }
+        
+        double l2_bytes_per_cycle = config_.l2_bandwidth_gb_s / config_.clock_freq_ghz;
+        cycles.l2 = config_.l2_latency_cycles + static_cast<int64_t>(bytes / l2_bytes_per_cycle);
+    }
+    
+    int64_t dram = dramCycles(load);
+    if (dram > 0) cycles.dram = config_.dram_latency_cycles + dram;
+    return cycles;
+}
+
+int64_t Simulator::simulateCompute(const codegen::Instruction& inst) {
+    // kernels that can't keep every lane busy run below peak
+    double flops_per_cycle = config_.compute_units * config_.simd_width * 2.0 * inst.efficiency;
+    int64_t cycles = static_cast<int64_t>(inst.flops / flops_per_cycle);
+    return std::max<int64_t>(cycles, 1);
 }
 
-int64_t Simulator::simulateLoad(const codegen::Instruction& inst) {
-    // check cache
-    bool cache_hit = cache_.access(0, inst.input_size);
+int64_t Simulator::simulateWeightLoad(const codegen::Instruction& inst, 
+                                      ExecutionStats& stats) {
+    // still resident from an earlier layer or prefetch, served at on-chip latency
+    if (weight_buffer_.accessResident(inst.value_id, inst.input_size)) {
+        stats.weight_reuse_hits++;
+        return config_.l2_latency_cycles;
+    }
     
-    if (cache_hit) {
-        return 10;
+    // weight-stationary: fetched once, reused by every batch element and tile;
+    // too large to stay stationary: each of them streams the whole weight again
+    int64_t fetches = 1;
+    if (inst.input_size > weight_buffer_.capacity()) {
+        fetches = std::max<int64_t>(1, inst.reuse);
+        stats.weight_buffer_spills++;
     } else {
-        // cache miss: load from mem
-        // cycles = data_size / (bandwidth * bytes_per_cycle)
-        double bytes_per_cycle = (config_.memory_bandwidth_gb_s * 1e9) / 
-                                 (config_.clock_freq_ghz * 1e9);
-        int64_t cycles = static_cast<int64_t>(inst.input_size / bytes_per_cycle);
-        return std::max(cycles, 100LL);
+        stats.weight_bytes_reused += inst.input_size * (inst.reuse - 1);
+    }
+    stats.weight_bytes_loaded += inst.input_size * fetches;
+    stats.memory_traffic_bytes += inst.input_size * fetches;
+    stats.sparse_index_bytes += inst.index_bytes * fetches;
+    
+    auto load = channelLoad();
+    for (int64_t f = 0; f < fetches; ++f) {
+        walkDram(inst.value_id, 0, inst.input_size, load, stats);
     }
+    return config_.dram_latency_cycles + dramCycles(load);
 }
 
-int64_t Simulator::simulateStore(const codegen::Instruction& inst) {
-    double bytes_per_cycle = (config_.memory_bandwidth_gb_s * 1e9) / 
-                             (config_.clock_freq_ghz * 1e9);
-    int64_t cycles = static_cast<int64_t>(inst.output_size / bytes_per_cycle);
-    return std::max(cycles, 100LL);
+int64_t Simulator::dramBase(int64_t tensor) const {
+    // tensors start on scattered rows, so unrelated streams share banks
+    uint64_t h = static_cast<uint64_t>(tensor) * 0x9E3779B97F4A7C15ull;
+    return static_cast<int64_t>(h >> 40) * config_.dram_row_bytes;
 }
 
-int64_t Simulator::simulateCompute(const codegen::Instruction& inst) {
-    double flops_per_cycle = config_.compute_units * config_.simd_width * 2.0;
-    int64_t cycles = static_cast<int64_t>(inst.flops / flops_per_cycle);
-    return std::max(cycles, 1LL);
+void Simulator::walkDram(int64_t tensor, int64_t offset, int64_t bytes, ChannelLoad& load,
+                         ExecutionStats& stats) {
+    // consecutive rows interleave across channels, then banks
+    int64_t row_bytes = std::max(config_.dram_row_bytes, 1);
+    int64_t channels = load.bytes.size();
+    int64_t banks = open_rows_.size() / channels;
+    int64_t addr = dramBase(tensor) + offset;
+    
+    stats.dram_bytes += bytes;
+    while (bytes > 0) {
+        int64_t row = addr / row_bytes;
+        int64_t len = std::min(bytes, row_bytes - addr % row_bytes);
+        int64_t channel = row % channels;
+        int64_t bank = channel * banks + (row / channels) % banks;
+        int64_t id = row / (channels * banks);
+        int64_t bursts = (len + kDramBurstBytes - 1) / kDramBurstBytes;
+        
+        if (open_rows_[bank] == id) {
+            stats.dram_row_hits += bursts;
+        } else {
+            if (open_rows_[bank] >= 0 && row_owner_[bank] != tensor) stats.dram_row_conflicts++;
+            open_rows_[bank] = id;
+            row_owner_[bank] = tensor;
+            stats.dram_row_misses++;
+            stats.dram_row_hits += bursts - 1;
+            load.misses[channel]++;
+        }
+        load.bytes[channel] += len;
+        addr += len;
+        bytes -= len;
+    }
 }
 
+int64_t Simulator::dramCycles(const ChannelLoad& load) const {
+    // channels transfer in parallel; a channel's row misses overlap across its banks
+    int64_t channels = load.bytes.size();
+    int64_t banks = open_rows_.size() / channels;
+    double bytes_per_cycle = config_.memory_bandwidth_gb_s / config_.clock_freq_ghz / channels;
+    double busiest = 0;
+    for (int64_t c = 0; c < channels; ++c) {
+        busiest = std::max(busiest, load.bytes[c] / bytes_per_cycle + 
+                                    static_cast<double>(load.misses[c]) * config_.dram_row_miss_cycles / banks);
+    }
+    return static_cast<int64_t>(busiest);
 }
+
+Simulator::ChannelLoad Simulator::channelLoad() const {
+    size_t channels = std::max(config_.dram_channels, 1);
+    return {std::vector<int64_t>(channels, 0), std::vector<int64_t>(channels, 0)};
 }
 
+}
+}
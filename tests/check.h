@@ -0,0 +1,33 @@
+#pragma once
+
+#include <iostream>
+
+// minimal checks: report every failure, exit code counts them
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+            checkFailures()++;                                                   \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                           \
+    do {                                                                         \
+        auto a_ = (a);                                                           \
+        auto b_ = (b);                                                           \
+        if (!(a_ == b_)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b \
+                      << ") failed: " << a_ << " vs " << b_ << "\n";             \
+            checkFailures()++;                                                   \
+        }                                                                        \
+    } while (0)
+
+inline int checkResult() {
+    if (checkFailures() == 0) std::cout << "all checks passed\n";
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include "check.h"
+#include "codegen/codegen.h"
+#include "support/quiet_stdout.h"
+
+using namespace dlcompiler;
+
+namespace {
+
+// one conv over a square input, padded to keep its size at stride 1
+codegen::ConvAlgorithm pick(int64_t c_in, int64_t size, int64_t c_out, int64_t kernel, 
+                            int64_t stride) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, c_in, size, size});
+    auto y = graph->addConv2D(x, c_out, kernel, stride, kernel / 2);
+    graph->addOutput(y);
+    
+    codegen::CodeGenerator codegen;
+    return codegen.selectConvAlgorithm(y->producer()).algorithm;
+}
+
+void testConvAlgorithmSelection() {
+    // a few output channels leave GEMM lanes idle, strided 3x3 rules out the transforms
+    CHECK(pick(64, 56, 3, 3, 2) == codegen::ConvAlgorithm::DIRECT);
+    // pointwise: a plain GEMM with no unfolding
+    CHECK(pick(64, 32, 64, 1, 1) == codegen::ConvAlgorithm::IM2COL_GEMM);
+    CHECK(pick(64, 32, 64, 3, 1) == codegen::ConvAlgorithm::WINOGRAD);
+    // large stride-1 filters
+    CHECK(pick(64, 28, 32, 5, 1) == codegen::ConvAlgorithm::FFT);
+}
+
+void testConvChoiceFollowsEdits() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, 64, 32, 32});
+    auto y = graph->addConv2D(x, 64, 3, 1, 1);
+    graph->addOutput(y);
+    auto* conv = y->producer();
+    
+    QuietStdout quiet;
+    codegen::CodeGenerator codegen;
+    codegen.generate(graph.get());
+    int64_t winograd = codegen.computeFLOPs(conv);
+    CHECK_EQ(winograd, codegen.selectConvAlgorithm(conv).flops);
+    
+    // a 1x1 edit goes unnoticed until the node is invalidated or regenerated
+    conv->setAttr("kernel_size", 1);
+    conv->setAttr("padding", 0);
+    graph->inferShape(conv);
+    CHECK_EQ(codegen.computeFLOPs(conv), winograd);
+    codegen.invalidate(conv->id());
+    CHECK_EQ(codegen.computeFLOPs(conv), codegen.selectConvAlgorithm(conv).flops);
+    CHECK(codegen.computeFLOPs(conv) < winograd);
+    
+    conv->setAttr("kernel_size", 3);
+    conv->setAttr("padding", 1);
+    graph->inferShape(conv);
+    codegen.generate(graph.get());
+    CHECK_EQ(codegen.computeFLOPs(conv), winograd);
+}
+
+}
+
+int main() {
+    testConvAlgorithmSelection();
+    testConvChoiceFollowsEdits();
+    return checkResult();
+}
@@ -0,0 +1,150 @@
+#include "check.h"
+#include "ir/graph.h"
+#include "optimizer/optimizer.h"
+#include "support/quiet_stdout.h"
+#include <functional>
+#include <stdexcept>
+
+using namespace dlcompiler;
+
+namespace {
+
+bool rejects(const std::function<void()>& build) {
+    try {
+        build();
+    } catch (const std::invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+void testSplitValidation() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({4, 96});
+    
+    CHECK(rejects([&] { graph->addSplit(x, 2, {32, 64}); }));
+    CHECK(rejects([&] { graph->addSplit(x, -1, {32, 64}); }));
+    CHECK(rejects([&] { graph->addSplit(x, 1, {32, 32}); }));
+    CHECK(rejects([&] { graph->addSplit(x, 1, {}); }));
+    CHECK(rejects([&] { graph->addSplit(x, 1, {0, 96}); }));
+    
+    auto pieces = graph->addSplit(x, 1, {32, 64});
+    CHECK_EQ(pieces.size(), 2u);
+    CHECK(pieces[1]->shape() == ir::Shape({4, 64}));
+}
+
+void testTransposeValidation() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({2, 3, 4});
+    
+    CHECK(rejects([&] { graph->addTranspose(x, {0, 1}); }));
+    CHECK(rejects([&] { graph->addTranspose(x, {0, 1, 3}); }));
+    CHECK(rejects([&] { graph->addTranspose(x, {0, 1, 1}); }));
+    CHECK(graph->addTranspose(x, {2, 0, 1})->shape() == ir::Shape({4, 2, 3}));
+}
+
+void testReshapeValidation() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({2, 3, 4});
+    
+    CHECK(rejects([&] { graph->addReshape(x, {5, 5}); }));
+    CHECK(rejects([&] { graph->addReshape(x, {5, -1}); }));
+    CHECK(rejects([&] { graph->addReshape(x, {-1, -1}); }));
+    CHECK(rejects([&] { graph->addReshape(x, {0, 24}); }));
+    CHECK(graph->addReshape(x, {6, -1})->shape() == ir::Shape({6, 4}));
+    
+    // symbolic sizes aren't known yet, so only the dims themselves are checked
+    auto dyn = graph->addInput(ir::Shape({ir::DimExpr::symbol("B"), 12}));
+    CHECK_EQ(graph->addReshape(dyn, {-1, 4})->shape().rank(), 2u);
+}
+
+
+void testAttentionValidation() {
+    auto graph = ir::Graph::create();
+    auto q = graph->addInput({2, 4, 16, 8});
+    auto k = graph->addInput({2, 4, 32, 8});
+    auto v = graph->addInput({2, 4, 32, 12});
+    
+    CHECK(rejects([&] { graph->addAttention(q, graph->addInput({2, 1, 32, 8}), v); }));
+    CHECK(rejects([&] { graph->addAttention(q, k, graph->addInput({2, 4, 16, 12})); }));
+    CHECK(rejects([&] { graph->addAttention(q, graph->addInput({2, 4, 32, 4}), v); }));
+    CHECK(rejects([&] { graph->addAttention(q, graph->addInput({32, 8}), v); }));
+    CHECK(graph->addAttention(q, k, v)->shape() == ir::Shape({2, 4, 16, 12}));
+}
+
+size_t countFused(int64_t kv_heads) {
+    auto graph = ir::Graph::create();
+    auto q = graph->addInput({2, 4, 16, 8});
+    auto k = graph->addInput({2, kv_heads, 16, 8});
+    auto v = graph->addInput({2, kv_heads, 16, 8});
+    auto scores = graph->addMatMul(q, graph->addTranspose(k, {0, 1, 3, 2}));
+    graph->addOutput(graph->addMatMul(graph->addSoftmax(scores), v));
+    
+    {
+        QuietStdout quiet;
+        optimizer::FusionPass().run(graph.get());
+    }
+    size_t fused = 0;
+    for (auto* node : graph->getNodesInTopoOrder()) {
+        if (node->type() == ir::OpType::FUSED_ATTENTION) fused++;
+    }
+    return fused;
+}
+
+void testAttentionFusionNeedsPerHeadKV() {
+    CHECK_EQ(countFused(4), 1u);
+    CHECK_EQ(countFused(1), 0u); // K/V broadcast across heads stays as batched matmuls
+}
+
+
+// prices a graph by its node count, or flat when split_penalty is 0
+class NodeCountCost : public optimizer::CostModel {
+public:
+    explicit NodeCountCost(int64_t split_penalty) : split_penalty_(split_penalty) {}
+    int64_t cycles(ir::Graph* graph) const override {
+        int64_t total = 0;
+        for (auto* node : graph->getNodes()) {
+            total += node->type() == ir::OpType::SPLIT ? split_penalty_ : 1;
+        }
+        return total;
+    }
+    
+private:
+    int64_t split_penalty_;
+};
+
+size_t countSplits(std::shared_ptr<const optimizer::CostModel> cost) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({16, 64});
+    for (int i = 0; i < 3; ++i) {
+        graph->addOutput(graph->addMatMul(x, graph->addParameter({64, 32})));
+    }
+    
+    {
+        QuietStdout quiet;
+        optimizer::HorizontalFusionPass(std::move(cost)).run(graph.get());
+    }
+    size_t splits = 0;
+    for (auto* node : graph->getNodes()) {
+        if (node->type() == ir::OpType::SPLIT) splits++;
+    }
+    return splits;
+}
+
+void testHorizontalFusionFollowsCostModel() {
+    CHECK_EQ(countSplits(nullptr), 1u);
+    CHECK_EQ(countSplits(std::make_shared<NodeCountCost>(0)), 1u);
+    CHECK_EQ(countSplits(std::make_shared<NodeCountCost>(100)), 0u);
+}
+
+}
+
+int main() {
+    testSplitValidation();
+    testTransposeValidation();
+    testReshapeValidation();
+    testAttentionValidation();
+    testAttentionFusionNeedsPerHeadKV();
+    testHorizontalFusionFollowsCostModel();
+    return checkResult();
+}
@@ -0,0 +1,184 @@
+#include "check.h"
+#include "compiler/incremental.h"
+#include "codegen/codegen.h"
+#include "simulator/simulator.h"
+#include <functional>
+#include <memory>
+
+using namespace dlcompiler;
+
+namespace {
+
+// 20 conv + relu layers; layer `wide` gets a 5x5 kernel that keeps the shape
+std::unique_ptr<ir::Graph> buildConvChain(std::vector<ir::Node*>& convs, int wide = -1) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, 16, 32, 32});
+    for (int i = 0; i < 20; ++i) {
+        x = i == wide ? graph->addConv2D(x, 16, 5, 1, 2) : graph->addConv2D(x, 16, 3, 1, 1);
+        convs.push_back(graph->getNode(graph->numNodes() - 1));
+        x = graph->addReLU(x);
+    }
+    graph->addOutput(x);
+    return graph;
+}
+
+// conv chain into a pooled MatMul + bias head; the bias is added as
+// Add(bias, x W), which only fuses once pooling keeps enough rows for x W
+// to match the bias
+std::unique_ptr<ir::Graph> buildPooledHead(ir::Node*& pool, int64_t pool_size) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, 16, 32, 32});
+    for (int i = 0; i < 10; ++i) {
+        x = graph->addReLU(graph->addConv2D(x, 16, 3, 1, 1));
+    }
+    x = graph->addMaxPool(x, pool_size, pool_size);
+    pool = x->producer();
+    x = graph->addMatMul(graph->addReshape(x, {-1, 64}), graph->addConstant({64, 16}));
+    graph->addOutput(graph->addAdd(graph->addConstant({256, 16}), x));
+    return graph;
+}
+
+// test-only region pass: a FusedConvReLU flagged "twin" gets a copy of
+// itself applied to its output, so an edit can add a node
+class TwinPass : public optimizer::Pass {
+public:
+    TwinPass() {
+        rules_.add({
+            "twin",
+            optimizer::Pattern::op(ir::OpType::FUSED_CONV_RELU).attrEq("twin", 1),
+            [](optimizer::Rewriter& rw, const optimizer::Match& m) {
+                auto* out = m.root->outputs()[0];
+                auto readers = rw.uses().at(out);
+                m.root->setAttr("twin", 0);
+                auto* twin = rw.cloneNode(m.root, {out, m.root->inputs()[1]});
+                for (auto* reader : readers) {
+                    auto inputs = reader->inputs();
+                    std::replace(inputs.begin(), inputs.end(), out, twin->outputs()[0]);
+                    rw.setInputs(reader, inputs);
+                }
+                return true;
+            }
+        });
+    }
+    
+    bool run(ir::Graph* graph) override {
+        return optimizer::PatternRewriteDriver(rules_).run(graph) > 0;
+    }
+    std::string name() const override { return "TwinPass"; }
+    bool runOnRegion(ir::Graph* graph, const std::vector<ir::Node*>& region,
+                     optimizer::RegionState& state) override {
+        return optimizer::PatternRewriteDriver(rules_).run(graph, region, state) > 0;
+    }
+    bool localizes() const override { return true; }
+    
+private:
+    optimizer::RewriteRuleSet rules_;
+};
+
+std::unique_ptr<optimizer::Optimizer> buildOptimizer() {
+    auto opt = std::make_unique<optimizer::Optimizer>();
+    opt->addPass(std::make_unique<optimizer::ConstantFoldingPass>());
+    opt->addPass(std::make_unique<optimizer::FusionPass>());
+    opt->addPass(std::make_unique<TwinPass>());
+    return opt;
+}
+
+simulator::ExecutionStats fullPipeline(ir::Graph* graph, const simulator::ChipConfig& config) {
+    buildOptimizer()->run(graph);
+    codegen::CodeGenerator codegen(config);
+    simulator::Simulator sim(config);
+    return sim.execute(codegen.generate(graph));
+}
+
+// full optimize + generate + execute on a graph built with the edit applied
+simulator::ExecutionStats fullPipeline(int wide, const simulator::ChipConfig& config) {
+    std::vector<ir::Node*> convs;
+    auto graph = buildConvChain(convs, wide);
+    return fullPipeline(graph.get(), config);
+}
+
+void checkSame(const simulator::ExecutionStats& inc, const simulator::ExecutionStats& full) {
+    CHECK_EQ(inc.cycles, full.cycles);
+    CHECK_EQ(inc.compute_cycles, full.compute_cycles);
+    CHECK_EQ(inc.memory_cycles, full.memory_cycles);
+    CHECK_EQ(inc.dram_bytes, full.dram_bytes);
+    CHECK_EQ(inc.l2_bytes, full.l2_bytes);
+    CHECK_EQ(inc.l2_writeback_bytes, full.l2_writeback_bytes);
+    CHECK_EQ(inc.cache_hits, full.cache_hits);
+    CHECK_EQ(inc.cache_misses, full.cache_misses);
+    CHECK_EQ(inc.weight_bytes_loaded, full.weight_bytes_loaded);
+    CHECK_EQ(inc.prefetch_hidden_cycles, full.prefetch_hidden_cycles);
+    CHECK_EQ(inc.contention_cycles, full.contention_cycles);
+    CHECK_EQ(inc.peak_sram_bytes, full.peak_sram_bytes);
+    CHECK_EQ(inc.peak_working_set_bytes, full.peak_working_set_bytes);
+    CHECK_EQ(inc.peak_activation_bytes, full.peak_activation_bytes);
+}
+
+void testMatchesFullCompile() {
+    simulator::ChipConfig config;
+    std::vector<ir::Node*> convs;
+    auto graph = buildConvChain(convs);
+    auto opt = buildOptimizer();
+    compiler::IncrementalCompiler inc(graph.get(), *opt, config);
+    
+    checkSame(inc.compile(), fullPipeline(-1, config));
+    CHECK(inc.stats().peak_activation_bytes > 0);
+    
+    // same-shape edit in the middle: only a few segments are redone
+    inc.setAttr(convs[10], "kernel_size", 5);
+    inc.setAttr(convs[10], "padding", 2);
+    checkSame(inc.update(), fullPipeline(10, config));
+    CHECK(inc.lastUpdate().reemitted < convs.size());
+}
+
+
+void testEditThatFuses() {
+    simulator::ChipConfig config;
+    ir::Node* pool = nullptr;
+    auto graph = buildPooledHead(pool, 2);
+    auto opt = buildOptimizer();
+    compiler::IncrementalCompiler inc(graph.get(), *opt, config);
+    inc.compile();
+    int nodes = graph->numNodes();
+    
+    // 1x1 pooling keeps all 256 rows, so MatMul + Add now fuse: the Add
+    // is spliced out of program order without a full recompile
+    inc.setAttr(pool, "kernel_size", 1);
+    inc.setAttr(pool, "stride", 1);
+    const auto& stats = inc.update();
+    CHECK_EQ(graph->numNodes(), nodes - 1);
+    CHECK(inc.lastUpdate().reemitted < static_cast<size_t>(graph->numNodes()));
+    
+    ir::Node* unused = nullptr;
+    auto fresh = buildPooledHead(unused, 1);
+    checkSame(stats, fullPipeline(fresh.get(), config));
+}
+
+void testEditThatAddsNode() {
+    simulator::ChipConfig config;
+    std::vector<ir::Node*> convs;
+    auto graph = buildConvChain(convs);
+    auto opt = buildOptimizer();
+    compiler::IncrementalCompiler inc(graph.get(), *opt, config);
+    inc.compile();
+    int nodes = graph->numNodes();
+    
+    inc.setAttr(convs[10], "twin", 1);
+    const auto& stats = inc.update();
+    CHECK_EQ(graph->numNodes(), nodes + 1);
+    CHECK(inc.lastUpdate().reemitted < convs.size());
+    
+    std::vector<ir::Node*> fresh_convs;
+    auto fresh = buildConvChain(fresh_convs);
+    fresh_convs[10]->setAttr("twin", 1);
+    checkSame(stats, fullPipeline(fresh.get(), config));
+}
+
+}
+
+int main() {
+    testMatchesFullCompile();
+    testEditThatFuses();
+    testEditThatAddsNode();
+    return checkResult();
+}
@@ -0,0 +1,147 @@
+#include "check.h"
+#include "optimizer/pattern.h"
+
+using namespace dlcompiler;
+using optimizer::Pattern;
+
+namespace {
+
+size_t countOps(ir::Graph* graph, ir::OpType type) {
+    size_t count = 0;
+    for (auto* node : graph->getNodes()) {
+        if (node->type() == type) count++;
+    }
+    return count;
+}
+
+// relu(conv) -> fused conv, the way FusionPass does it
+optimizer::RewriteRule convReluRule() {
+    return {
+        "conv_relu",
+        Pattern::op(ir::OpType::RELU).operands({
+            Pattern::op(ir::OpType::CONV2D).singleUse().bind("conv")
+        }),
+        [](optimizer::Rewriter& rw, const optimizer::Match& m) {
+            auto* conv = m.node("conv");
+            rw.setType(conv, ir::OpType::FUSED_CONV_RELU);
+            rw.replaceAllUsesWith(m.root->outputs()[0], conv->outputs()[0]);
+            rw.eraseNode(m.root);
+            return true;
+        }
+    };
+}
+
+void testDriverRewritesToFixpoint() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, 8, 16, 16});
+    for (int i = 0; i < 4; ++i) {
+        x = graph->addReLU(graph->addConv2D(x, 8, 3, 1, 1));
+    }
+    graph->addOutput(x);
+    
+    optimizer::RewriteRuleSet rules;
+    rules.add(convReluRule());
+    CHECK_EQ(optimizer::PatternRewriteDriver(rules).run(graph.get()), 4);
+    CHECK_EQ(countOps(graph.get(), ir::OpType::RELU), 0u);
+    CHECK_EQ(countOps(graph.get(), ir::OpType::FUSED_CONV_RELU), 4u);
+    
+    // nothing left to match
+    CHECK_EQ(optimizer::PatternRewriteDriver(rules).run(graph.get()), 0);
+}
+
+void testSingleUseGuard() {
+    auto graph = ir::Graph::create();
+    auto conv = graph->addConv2D(graph->addInput({1, 8, 16, 16}), 8, 3, 1, 1);
+    graph->addOutput(graph->addReLU(conv));
+    graph->addOutput(conv); // pre-activation is needed too
+    
+    optimizer::RewriteRuleSet rules;
+    rules.add(convReluRule());
+    CHECK_EQ(optimizer::PatternRewriteDriver(rules).run(graph.get()), 0);
+    CHECK_EQ(countOps(graph.get(), ir::OpType::RELU), 1u);
+    CHECK_EQ(countOps(graph.get(), ir::OpType::CONV2D), 1u);
+}
+
+void testCommutativeOperands() {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({4, 16});
+    auto mm = [&] { return graph->addMatMul(x, graph->addConstant({16, 16})); };
+    auto bias = graph->addConstant({4, 16});
+    auto left = graph->addAdd(mm(), bias);
+    auto right = graph->addAdd(bias, mm());
+    graph->addOutput(left);
+    graph->addOutput(right);
+    
+    // the bias must bind to the constant whichever side it's on
+    auto bindsMatMul = [](optimizer::Rewriter& rw, const optimizer::Match& m) {
+        if (!m.value("bias")->isConstant()) return false;
+        m.root->setAttr("matched", 1);
+        rw.notifyChanged(m.root);
+        return true;
+    };
+    auto pattern = [](bool commutative) {
+        auto p = Pattern::op(ir::OpType::ADD).attrEq("matched", 0).operands({
+            Pattern::op(ir::OpType::MATMUL).bind("mm"),
+            Pattern::any().bind("bias")
+        });
+        if (commutative) p.commutative();
+        return p;
+    };
+    
+    optimizer::RewriteRuleSet ordered;
+    ordered.add({"ordered", pattern(false), bindsMatMul});
+    CHECK_EQ(optimizer::PatternRewriteDriver(ordered).run(graph.get()), 1);
+    CHECK_EQ(left->producer()->getAttr("matched"), 1);
+    CHECK_EQ(right->producer()->getAttr("matched"), 0);
+    
+    optimizer::RewriteRuleSet either;
+    either.add({"either", pattern(true), bindsMatMul});
+    CHECK_EQ(optimizer::PatternRewriteDriver(either).run(graph.get()), 1);
+    CHECK_EQ(right->producer()->getAttr("matched"), 1);
+}
+
+void testWorklistQueuesOnce() {
+    optimizer::Worklist worklist;
+    worklist.push(3);
+    worklist.push(5);
+    worklist.push(3);
+    CHECK_EQ(worklist.size(), 2u);
+    CHECK_EQ(worklist.pop(), 3);
+    worklist.push(3); // popped, so it may come back
+    CHECK_EQ(worklist.size(), 2u);
+    
+    // repeated edits to one node requeue its readers once
+    auto graph = ir::Graph::create();
+    graph->addOutput(graph->addReLU(graph->addInput({4, 16})));
+    int output_visits = 0;
+    optimizer::RewriteRuleSet rules;
+    rules.add({
+        "retag",
+        Pattern::op(ir::OpType::RELU).attrEq("tagged", 0),
+        [](optimizer::Rewriter& rw, const optimizer::Match& m) {
+            m.root->setAttr("tagged", 1);
+            for (int i = 0; i < 3; ++i) rw.setType(m.root, ir::OpType::RELU);
+            return true;
+        }
+    });
+    rules.add({
+        "visit",
+        Pattern::op(ir::OpType::OUTPUT).where([&](const ir::Node*) {
+            output_visits++;
+            return false;
+        }),
+        [](optimizer::Rewriter&, const optimizer::Match&) { return false; }
+    });
+    CHECK_EQ(optimizer::PatternRewriteDriver(rules).run(graph.get()), 1);
+    CHECK_EQ(output_visits, 1);
+}
+
+}
+
+int main() {
+    testDriverRewritesToFixpoint();
+    testSingleUseGuard();
+    testCommutativeOperands();
+    testWorklistQueuesOnce();
+    return checkResult();
+}
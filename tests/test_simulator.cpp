@@ -0,0 +1,39 @@
+#include "check.h"
+#include "simulator/simulator.h"
+
+using namespace dlcompiler;
+
+namespace {
+
+codegen::Instruction weightLoad(int value_id, int64_t bytes, int64_t reuse) {
+    codegen::Instruction load{codegen::InstructionType::LOAD, "MatMul", bytes, 0, 0};
+    load.value_id = value_id;
+    load.is_weight = true;
+    load.reuse = reuse;
+    return load;
+}
+
+void testSpilledWeightRestreamsPerReuse() {
+    simulator::ChipConfig config;
+    config.weight_buffer_kb = 64;
+    const int64_t buffer = 64 * 1024;
+    
+    // fits: fetched once, reused from the buffer
+    auto fits = simulator::Simulator(config).execute({weightLoad(1, buffer / 2, 8)});
+    CHECK_EQ(fits.weight_bytes_loaded, buffer / 2);
+    CHECK_EQ(fits.weight_buffer_spills, 0);
+    
+    // only a slice stays on chip, so every reuse reloads all of it, not
+    // just one pass per buffer-sized chunk
+    auto spilled = simulator::Simulator(config).execute({weightLoad(1, 3 * buffer, 8)});
+    CHECK_EQ(spilled.weight_buffer_spills, 1);
+    CHECK_EQ(spilled.weight_bytes_loaded, 8 * 3 * buffer);
+    CHECK_EQ(spilled.memory_traffic_bytes, 8 * 3 * buffer);
+}
+
+}
+
+int main() {
+    testSpilledWeightRestreamsPerReuse();
+    return checkResult();
+}
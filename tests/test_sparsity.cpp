@@ -0,0 +1,64 @@
+#include "check.h"
+#include "codegen/codegen.h"
+#include "simulator/simulator.h"
+#include <map>
+#include <memory>
+
+using namespace dlcompiler;
+
+namespace {
+
+// one pruned 3x3 conv
+std::unique_ptr<ir::Graph> buildPrunedConv(const ir::Sparsity& sparsity, int64_t c_in = 64) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({1, c_in, 28, 28});
+    auto y = graph->addConv2D(x, 64, 3, 1, 1);
+    y->producer()->setSparsity(sparsity);
+    graph->addOutput(y);
+    return graph;
+}
+
+std::map<std::string, int64_t> sparseFormats(const ir::Sparsity& sparsity, 
+                                             codegen::ConvAlgorithm algorithm,
+                                             int64_t c_in = 64) {
+    auto graph = buildPrunedConv(sparsity, c_in);
+    simulator::ChipConfig config;
+    codegen::CodeGenerator codegen(config);
+    codegen.forceConvAlgorithm(algorithm);
+    simulator::Simulator sim(config);
+    return sim.execute(codegen.generate(graph.get())).sparse_formats;
+}
+
+void testWinogradIsDense() {
+    // winograd filters are transformed dense, so the pruned weights are
+    // neither packed nor expanded
+    for (auto algorithm : {codegen::ConvAlgorithm::WINOGRAD, codegen::ConvAlgorithm::FFT}) {
+        auto formats = sparseFormats(ir::Sparsity::unstructured(0.3), algorithm);
+        CHECK_EQ(formats.size(), 1u);
+        CHECK_EQ(formats["dense"], 1);
+    }
+}
+
+void testDirectKeepsPackedFormat() {
+    auto formats = sparseFormats(ir::Sparsity::nOfM(2, 4), codegen::ConvAlgorithm::DIRECT);
+    CHECK_EQ(formats.size(), 1u);
+    CHECK_EQ(formats.count("dense"), 0u);
+    CHECK_EQ(formats.count("dense expanded"), 0u);
+}
+
+
+void testRaggedNofMLowersDense() {
+    // C_in * 3 * 3 = 27 doesn't split into groups of 4
+    auto formats = sparseFormats(ir::Sparsity::nOfM(2, 4), codegen::ConvAlgorithm::DIRECT, 3);
+    CHECK_EQ(formats.size(), 1u);
+    CHECK_EQ(formats["dense"], 1);
+}
+
+}
+
+int main() {
+    testWinogradIsDense();
+    testDirectKeepsPackedFormat();
+    testRaggedNofMLowersDense();
+    return checkResult();
+}
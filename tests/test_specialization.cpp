@@ -0,0 +1,95 @@
+#include "check.h"
+#include "compiler/specialization.h"
+#include "support/quiet_stdout.h"
+
+using namespace dlcompiler;
+
+namespace {
+
+compiler::SpecializationCache buildCache(optimizer::Optimizer& opt, size_t max_exact) {
+    auto graph = ir::Graph::create();
+    auto x = graph->addInput({ir::DimExpr::symbol("S"), ir::DimExpr(64)});
+    graph->addOutput(graph->addReLU(graph->addMatMul(x, graph->addConstant({64, 64}))));
+    
+    compiler::SpecializationCache cache(std::move(graph), opt, max_exact);
+    cache.setBuckets("S", {128, 256});
+    cache.compile();
+    return cache;
+}
+
+int64_t compiledFor(compiler::SpecializationCache& cache, int64_t s) {
+    return cache.lookup({{"S", s}}).bindings.at("S");
+}
+
+void testDimExprEquality() {
+    auto a = ir::DimExpr::symbol("a");
+    auto b = ir::DimExpr::symbol("b");
+    auto c = ir::DimExpr::symbol("c");
+    
+    CHECK(a + 1 == ir::DimExpr::symbol("a") + 1);
+    CHECK(ir::DimExpr(8) == ir::DimExpr(4) * 2);
+    CHECK(a != b);
+    CHECK(a + b != b + a);
+    CHECK(a != ir::DimExpr(0));
+    // print the same, floor-divide differently
+    CHECK((a * b).floorDiv(c) != a * b.floorDiv(c));
+}
+
+void testBucketHitsPadUp() {
+    QuietStdout quiet;
+    optimizer::Optimizer opt;
+    auto cache = buildCache(opt, 4);
+    CHECK_EQ(cache.numVariants(), 2u);
+    
+    CHECK_EQ(compiledFor(cache, 100), 128);
+    CHECK_EQ(compiledFor(cache, 128), 128);
+    CHECK_EQ(compiledFor(cache, 129), 256);
+    CHECK_EQ(cache.bucketHits(), 3);
+    CHECK_EQ(cache.fallbacks(), 0);
+    CHECK_EQ(cache.numVariants(), 2u);
+}
+
+void testMissCompilesExactShape() {
+    QuietStdout quiet;
+    optimizer::Optimizer opt;
+    auto cache = buildCache(opt, 4);
+    
+    CHECK_EQ(compiledFor(cache, 300), 300);
+    CHECK_EQ(cache.numVariants(), 3u);
+    // second miss on the same shape reuses it
+    CHECK_EQ(compiledFor(cache, 300), 300);
+    CHECK_EQ(cache.numVariants(), 3u);
+    CHECK_EQ(cache.fallbacks(), 2);
+    CHECK_EQ(cache.bucketHits(), 0);
+}
+
+void testExactShapesEvictLeastRecent() {
+    QuietStdout quiet;
+    optimizer::Optimizer opt;
+    auto cache = buildCache(opt, 2);
+    
+    compiledFor(cache, 300);
+    compiledFor(cache, 400);
+    compiledFor(cache, 300); // 400 is now the oldest
+    CHECK_EQ(cache.evictions(), 0);
+    
+    compiledFor(cache, 500);
+    CHECK_EQ(cache.evictions(), 1);
+    CHECK_EQ(cache.numVariants(), 4u);
+    compiledFor(cache, 300); // still cached
+    CHECK_EQ(cache.evictions(), 1);
+    compiledFor(cache, 400); // was evicted, pushes out 500
+    CHECK_EQ(cache.evictions(), 2);
+    compiledFor(cache, 300);
+    CHECK_EQ(cache.evictions(), 2);
+}
+
+}
+
+int main() {
+    testDimExprEquality();
+    testBucketHitsPadUp();
+    testMissCompilesExactShape();
+    testExactShapesEvictLeastRecent();
+    return checkResult();
+}